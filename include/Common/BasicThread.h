@@ -20,10 +20,12 @@
 #include <atomic>
 #include <iostream>
 #include <functional>
+#include <future>
 #include <stdexcept>
 #include <system_error>
 #include <string>
 #include <thread>
+#include "Common/ThreadOptions.h"
 
 namespace AliceO2
 {
@@ -36,12 +38,27 @@ class BasicThread
 {
  public:
   /// Start thread
-  /// \param stopFlag Pointer to flag indicating the function should stop
-  void start(std::function<void(std::atomic<bool>* stopFlag)> function)
+  /// \param function Function to execute. Its stopFlag argument points to flag indicating the function should stop
+  /// \param options Thread options (CPU affinity, scheduling, name), applied in the new thread before calling the function
+  /// \param errorMessage If not null, set with the description of the options which could not be applied, if any
+  /// \return 0 on success, -1 if some options could not be applied (thread is running anyway)
+  int start(std::function<void(std::atomic<bool>* stopFlag)> function, const ThreadOptions& options = {}, std::string* errorMessage = nullptr)
   {
     join();
     mStopFlag = false;
-    mThread = std::thread(function, &mStopFlag);
+    std::promise<int> started;
+    std::future<int> startedFuture = started.get_future();
+    auto threadMain = [&started, &options, errorMessage, function](std::atomic<bool>* stopFlag) {
+      std::string message;
+      int status = applyThreadOptions(options, message);
+      if (errorMessage != nullptr) {
+        *errorMessage = message;
+      }
+      started.set_value(status);
+      function(stopFlag);
+    };
+    mThread = std::thread(threadMain, &mStopFlag);
+    return startedFuture.get();
   }
 
   void stop()
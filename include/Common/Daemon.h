@@ -15,24 +15,31 @@
 /// \author Sylvain Chapeland, CERN
 
 #include "SimpleLog.h"
+#include <atomic>
 #include <string>
 #include <vector>
 
 #include <Common/Configuration.h>
+#include <Common/ThreadOptions.h>
 
 // class to define parameters for daemon runtime behavior.
 // default values are defined.
 class DaemonConfigParameters
 {
  public:
-  int isInteractive = 0;      // flag set when process to be kept in foreground
-  int idleSleepTime = 100000; // sleep time in microseconds when doLoop() idle
-  std::string userName;       // user name under which should run the process. Not changed if empty.
-  int redirectOutput = 0;     // flag set to redirect stdout/stderr to /dev/null
-  std::string logFile;        // log file (leave empty to keep stdout/stderr)
-  int logRotateMaxBytes = 0;  // log file max size (0: unlimited)
-  int logRotateMaxFiles = 0;  // log file max number of files kept (0:unlimited)
-  int logRotateNow = 0;       // log file rotate now (0: append current, 1: create new)
+  int isInteractive = 0;        // flag set when process to be kept in foreground
+  int idleSleepTime = 100000;   // sleep time in microseconds when doLoop() idle
+  std::string userName;         // user name under which should run the process. Not changed if empty.
+  int redirectOutput = 0;       // flag set to redirect stdout/stderr to /dev/null
+  std::string logFile;          // log file (leave empty to keep stdout/stderr)
+  int logRotateMaxBytes = 0;    // log file max size (0: unlimited)
+  int logRotateMaxFiles = 0;    // log file max number of files kept (0:unlimited)
+  int logRotateNow = 0;         // log file rotate now (0: append current, 1: create new)
+  std::string cpuSet;           // CPUs on which the main loop may run, e.g. "0-3,8" (leave empty for no restriction)
+  std::string schedulingPolicy; // scheduling policy of the main loop: other, batch, idle, fifo, rr (leave empty to keep default)
+  int schedulingPriority = 0;   // scheduling priority (1-99), for fifo and rr policies
+  int niceValue = 0;            // nice value of the main loop (0: unchanged)
+  std::string threadName;       // name of the main loop thread, as seen by the kernel (leave empty to keep process name)
 };
 
 // a class to initialize and run a daemon process
@@ -79,6 +86,9 @@ class Daemon
   // If returns Ok, called again immediately.
   virtual LoopStatus doLoop();
 
+  // Get the flag set when termination is requested (e.g. by signal), e.g. to stop a ThreadPool with ThreadPool::setStopFlag().
+  static const std::atomic<bool>& getShutdownFlag();
+
  protected:
   SimpleLog log;     // object for output logging.
   ConfigFile config; // input configuration file, if any. Loaded if path provided on command line.
@@ -90,6 +100,8 @@ class Daemon
 
   std::vector<ConfigOption> execOptions; // options extracted from command line arguments (-o key=value)
 
+  AliceO2::Common::ThreadOptions threadOptions; // thread options from configuration parameters, applied to the main loop. Can be reused for other threads.
+
   // check daemon status (e.g. after constructor, before starting main loop by calling run(), to know if init success)
   bool isOk();
 
@@ -16,32 +16,363 @@
 ///
 
 #include <string>
+#include <string_view>
 #include <queue>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
 
+/// Data is kept in a single contiguous buffer, reused between reads: lines are not copied when extracted,
+/// and can be retrieved as std::string_view pointing directly to the buffer content.
+/// By default, lines are terminated by '\n'. Other framings of records can be selected with setFraming...() functions,
+/// e.g. for binary streams: the functions to retrieve lines then return records.
 class LineBuffer
 {
  public:
   /// Constructor
-  LineBuffer();
+  /// \param[in] bufferSize  initial size of the buffer, in bytes. It grows when needed (e.g. for lines longer than buffer).
+  explicit LineBuffer(size_t bufferSize = 64 * 1024);
 
   /// Destructor
   ~LineBuffer();
 
   /// Read from file descriptor and add content to buffer
+  /// If the buffer is full (see setMaxLines()), nothing is read and the call returns immediately.
   /// \param[in] fd          file descriptor to read from
   /// \param[in] timeout     timeout in milliseconds, -1 for blocking call
   /// \return 0 on success, -1 if EOF
   int appendFromFileDescriptor(int fd, int timeout);
 
+  /// Add content to buffer
+  /// \param[in] data        data to be added, possibly containing several lines, or part of a line
+  /// \param[in] size        number of bytes in data
+  void appendData(const char* data, size_t size);
+
+  /// Move the incomplete line at end of buffer, if any, to the complete lines (e.g. when reaching end of input)
+  void flush();
+
   // Retrieve next complete line from buffer, immediate returns.
   /// \param[out] nextLine    Next complete line from buffer.
   /// \return 0 on success, -1 if no complete line yet
   int getNextLine(std::string& nextLine);
 
-  //void appendString(const char *s);
+  /// Retrieve next complete line from buffer, without copy, immediate returns.
+  /// The line is valid until next call adding content to buffer (appendFromFileDescriptor(), appendData(), flush()).
+  /// \param[out] nextLine    Next complete line from buffer (without end of line).
+  /// \return 0 on success, -1 if no complete line yet
+  int getNextLine(std::string_view& nextLine);
+
+  /// Retrieve all complete lines from buffer, without copy, immediate returns.
+  /// Lines are valid until next call adding content to buffer, see getNextLine().
+  /// \param[out] lines       Complete lines, appended to the vector.
+  /// \return number of lines retrieved
+  size_t getLines(std::vector<std::string_view>& lines);
+
+  /// Framings of records in input data
+  enum FramingMode { FramingDelimiter,   // records terminated by a delimiter byte, not included in returned records (default, with '\n')
+                     FramingFixedSize,   // records of a fixed number of bytes
+                     FramingLengthPrefix // records preceded by their length, as an unsigned integer, not included in returned records
+  };
+
+  /// Set framing to records terminated by a delimiter byte. The default is lines, terminated by '\n'.
+  /// \param[in] delimiter   record delimiter
+  /// \return 0 on success, -1 on error
+  int setFramingDelimiter(char delimiter = '\n');
+
+  /// Set framing to fixed-size records. Not compatible with limits (setMaxLineLength(), setMaxLines()).
+  /// \param[in] recordSize  size of a record, in bytes
+  /// \return 0 on success, -1 on error
+  int setFramingFixedSize(size_t recordSize);
+
+  /// Set framing to length-prefixed records. Not compatible with limits (setMaxLineLength(), setMaxLines()).
+  /// \param[in] prefixSize  size of the length field, in bytes: 1, 2, 4, or 8. The length does not include the prefix.
+  /// \param[in] isBigEndian byte order of the length field. Default is network byte order.
+  /// \return 0 on success, -1 on error
+  int setFramingLengthPrefix(size_t prefixSize, bool isBigEndian = true);
+
+  /// Implementations of the search for ends of lines
+  enum ScanMethod { ScanAuto,   // fastest available on this CPU
+                    ScanMemchr, // standard memchr()
+                    ScanSSE2,   // x86 SSE2 instructions, 16 bytes at a time
+                    ScanAVX2    // x86 AVX2 instructions, 32 bytes at a time
+  };
+
+  /// Select the implementation used to search ends of lines, for all LineBuffer objects.
+  /// The default is ScanAuto, selected at startup. Not thread-safe: should be called before using LineBuffer objects.
+  /// \param[in] method      implementation to be used
+  /// \return 0 on success, -1 if not supported on this CPU
+  static int setScanMethod(ScanMethod method);
+
+  /// Policies applied when a limit of the buffer is reached
+  enum OverflowPolicy { OverflowSplit, // line is split: a line end is inserted at the limit
+                        OverflowDrop,  // line is dropped
+                        OverflowBlock  // reading stops, until lines are retrieved (for a pipe or socket, the writer is then blocked by the kernel)
+  };
+
+  /// Set the maximum length of a line. Only for FramingDelimiter. By default, there is no limit, and the incomplete line can grow until an end of line is received.
+  /// \param[in] maxLength   maximum line length, in bytes. If zero, no limit.
+  /// \param[in] policy      what to do with longer lines: OverflowSplit or OverflowDrop
+  /// \return 0 on success, -1 if policy not supported
+  int setMaxLineLength(size_t maxLength, OverflowPolicy policy = OverflowSplit);
+
+  /// Set the maximum number of complete lines in buffer, not yet retrieved. Only for FramingDelimiter. By default, there is no limit.
+  /// With OverflowBlock, the limit may be exceeded by the lines received in a single read.
+  /// \param[in] maxLines    maximum number of lines. If zero, no limit.
+  /// \param[in] policy      what to do when the limit is reached: OverflowBlock, or OverflowDrop (new data is discarded)
+  /// \return 0 on success, -1 if policy not supported
+  int setMaxLines(size_t maxLines, OverflowPolicy policy = OverflowBlock);
+
+  /// Check if the maximum number of lines is reached with OverflowBlock policy, i.e. if no data is read until lines are retrieved
+  /// \return true if full
+  bool isFull() const;
+
+  /// Counters of lines affected by limits
+  struct Stats {
+    unsigned long droppedLines; // number of lines dropped (too long, or received when buffer full)
+    unsigned long splitLines;   // number of line ends inserted to split long lines
+    unsigned long blockedReads; // number of times reading was suspended because buffer full
+  };
+
+  /// Get counters of lines affected by limits, since creation
+  /// \return counters
+  Stats getStats() const;
 
  private:
-  std::queue<std::string> completeLines;
-  std::string pendingLine;
+  /// Make sure there is free space at end of buffer. Lines previously retrieved are invalidated.
+  /// \param[in] size        number of bytes needed
+  void reserveSpace(size_t size);
+
+  /// Read once from file descriptor, and add content to buffer
+  /// \param[in] fd          file descriptor to read from
+  /// \return as read(): number of bytes read, 0 if EOF, -1 on error
+  ssize_t readFromFileDescriptor(int fd);
+
+  /// Apply limits to data added to the buffer
+  /// \param[in] from        position in buffer of the first byte added
+  void checkLimits(size_t from);
+
+  /// Update lineStart and nLines from buffer content, e.g. when limits are set
+  void initLimits();
+
+  /// Count ends of lines in part of buffer
+  /// \param[in] from        start position
+  /// \param[in] to          end position
+  /// \param[out] lastEnd    position after the last end of line found. Unchanged if none.
+  /// \return number of ends of lines
+  size_t countLines(size_t from, size_t to, size_t& lastEnd);
+
+  /// Get size of next record in buffer, for framings other than delimiter
+  /// \return size in bytes (including length prefix, if any), or 0 if not known yet
+  size_t getRecordSize() const;
+
+  /// Retrieve next complete record from buffer, for framings other than delimiter
+  /// \param[out] nextRecord  Next complete record from buffer (without length prefix).
+  /// \return 0 on success, -1 if no complete record yet
+  int getNextRecord(std::string_view& nextRecord);
+
+  std::vector<char> buffer; // data: lines not yet retrieved, followed by incomplete line
+  size_t begin = 0;         // start of data not yet retrieved
+  size_t end = 0;           // end of data
+  size_t scanPos = 0;       // position from where to search next end of line. There is none between begin and scanPos.
+
+  // framing, see setFraming...()
+  FramingMode framing = FramingDelimiter; // current framing
+  char delimiter = '\n';                  // record delimiter, for FramingDelimiter
+  size_t recordSize = 0;                  // record size, for FramingFixedSize
+  size_t prefixSize = 0;                  // size of length prefix, for FramingLengthPrefix
+  bool prefixBigEndian = true;            // byte order of length prefix, for FramingLengthPrefix
+
+  // limits, see setMaxLineLength() and setMaxLines()
+  size_t maxLineLength = 0;                        // maximum line length, zero when no limit
+  OverflowPolicy lineLengthPolicy = OverflowSplit; // policy for long lines
+  size_t maxLines = 0;                             // maximum number of lines in buffer, zero when no limit
+  OverflowPolicy maxLinesPolicy = OverflowBlock;   // policy when too many lines
+  size_t lineStart = 0;                            // start of incomplete line. Maintained only when there are limits.
+  size_t nLines = 0;                               // number of complete lines in buffer. Maintained only when there are limits.
+  bool isDroppingLine = false;                     // set when data is discarded until next end of line
+  Stats stats = {};                                // counters
+
+  friend class LineBufferMultiplexer;
+  friend class LineFileReader;
 };
 
+/// \brief   Class to read lines from many file descriptors at once (e.g. outputs of child processes).
+/// File descriptors are registered in a single epoll instance, and only those with data available are read on each call,
+/// so that the cost of a call depends on the number of descriptors ready, not on the number registered.
+/// Lines are returned with the descriptor they come from.
+class LineBufferMultiplexer
+{
+ public:
+  /// Constructor
+  /// Throws an exception if the epoll instance can not be created.
+  LineBufferMultiplexer();
+
+  /// Destructor
+  /// Registered file descriptors are not closed.
+  ~LineBufferMultiplexer();
+
+  /// Register a file descriptor to read from
+  /// \param[in] fd          file descriptor, it should be readable (e.g. pipe, socket, terminal)
+  /// \return 0 on success, -1 on error (e.g. already registered)
+  int addFileDescriptor(int fd);
+
+  /// Unregister a file descriptor. Its pending lines are discarded. The file descriptor is not closed.
+  /// \param[in] fd          file descriptor
+  /// \return 0 on success, -1 if not registered
+  int removeFileDescriptor(int fd);
+
+  /// Wait for data on registered file descriptors, and add it to their buffer.
+  /// Each descriptor ready is read once per call. On end of file, the incomplete last line (if any) is added to the complete lines,
+  /// the descriptor is unregistered after its lines have been retrieved, and it is reported by getNextClosed().
+  /// \param[in] timeout     timeout in milliseconds, -1 for blocking call
+  /// \return number of descriptors read, or -1 on error
+  int appendFromFileDescriptors(int timeout);
+
+  /// Retrieve next complete line from buffers, immediate returns.
+  /// Lines of a given file descriptor are returned in order.
+  /// \param[out] fd          file descriptor the line was read from
+  /// \param[out] nextLine    Next complete line.
+  /// \return 0 on success, -1 if no complete line yet
+  int getNextLine(int& fd, std::string& nextLine);
+
+  /// Retrieve next complete line from buffers, without copy, immediate returns. See getNextLine() above.
+  /// The line is valid until next call to appendFromFileDescriptors().
+  int getNextLine(int& fd, std::string_view& nextLine);
+
+  /// Retrieve next file descriptor which reached end of file (or error), once all its lines were retrieved with getNextLine().
+  /// It is not registered anymore, and can be closed.
+  /// \param[out] fd          file descriptor
+  /// \return 0 on success, -1 if none
+  int getNextClosed(int& fd);
+
+  /// Get number of registered file descriptors
+  /// \return number of file descriptors
+  size_t getNumberOfFileDescriptors() const;
+
+  /// Set the framing of records, for all file descriptors (current and next ones). See LineBuffer::setFramingDelimiter().
+  int setFramingDelimiter(char delimiter = '\n');
+
+  /// Set the framing of records, for all file descriptors (current and next ones). See LineBuffer::setFramingFixedSize().
+  int setFramingFixedSize(size_t recordSize);
+
+  /// Set the framing of records, for all file descriptors (current and next ones). See LineBuffer::setFramingLengthPrefix().
+  int setFramingLengthPrefix(size_t prefixSize, bool isBigEndian = true);
+
+  /// Set the maximum length of a line, for all file descriptors (current and next ones). See LineBuffer::setMaxLineLength().
+  int setMaxLineLength(size_t maxLength, LineBuffer::OverflowPolicy policy = LineBuffer::OverflowSplit);
+
+  /// Set the maximum number of lines buffered per file descriptor (current and next ones). See LineBuffer::setMaxLines().
+  /// With OverflowBlock, a file descriptor with a full buffer is not polled until some of its lines are retrieved.
+  int setMaxLines(size_t maxLines, LineBuffer::OverflowPolicy policy = LineBuffer::OverflowBlock);
+
+  /// Get counters of lines affected by limits, summed for all file descriptors (including those not registered anymore)
+  /// \return counters
+  LineBuffer::Stats getStats() const;
+
+ private:
+  // state of a registered file descriptor
+  struct Source {
+    LineBuffer buffer;           // lines read
+    bool isClosed = false;       // set when end of file reached
+    bool isInReadyQueue = false; // set when in the list of sources with lines
+    bool isPaused = false;       // set when not polled, because buffer full
+  };
+
+  // apply current framing and limits to all buffers
+  void applySettings();
+
+  // apply current framing and limits to a buffer
+  void applySettings(LineBuffer& buffer);
+
+  // add counters of a source to those of sources removed
+  void addStats(const Source& source);
+
+  // poll again a paused source, if its buffer is not full anymore
+  void resumeSource(int fd, Source& source);
+
+  int epollFd = -1;                                         // epoll instance
+  std::unordered_map<int, std::unique_ptr<Source>> sources; // registered file descriptors
+  std::queue<int> readyQueue;                               // file descriptors which may have complete lines, in order of reading
+  std::queue<int> closedQueue;                              // file descriptors closed, not yet retrieved
+  std::vector<std::unique_ptr<Source>> releasedSources;     // sources closed and retrieved, destroyed on next read
+  LineBuffer settings{ 0 };                                 // empty buffer, holding framing and limits applied to all sources
+  LineBuffer::Stats removedStats = {};                      // counters of sources not registered anymore
+};
+
+/// \brief   Class to read lines from a regular file, e.g. to parse large log files offline.
+/// The file is either read in large chunks, or mapped in memory and lines are then returned directly from the mapping.
+/// A file can be split in parts aligned on ends of lines (see splitFile()), to be processed in parallel by several threads,
+/// each with its own LineFileReader.
+class LineFileReader
+{
+ public:
+  /// Methods to access the file
+  enum ReadMode { ReadAuto,   // default method, currently chunks: page faults on a mapping were measured to cost more than copies of large reads
+                  ReadMapped, // file mapped in memory with mmap(). Lines stay valid until file is closed. Regular files only.
+                  ReadChunks  // file read in large chunks, with sequential access hint
+  };
+
+  /// Part of a file, see splitFile()
+  struct FilePart {
+    off_t offset; // start of part, in bytes from beginning of file
+    off_t size;   // size of part, in bytes
+  };
+
+  /// Constructor
+  LineFileReader();
+
+  /// Destructor
+  /// File is closed, if any.
+  ~LineFileReader();
+
+  /// Open a file, or a part of it. The file previously opened, if any, is closed.
+  /// \param[in] path        path to the file
+  /// \param[in] mode        method to access the file
+  /// \param[in] part        part of file to read. By default, the whole file.
+  /// \return 0 on success, -1 on error (errno is set)
+  int open(const char* path, ReadMode mode = ReadAuto, const FilePart* part = nullptr);
+
+  /// Close the file. Lines previously retrieved are invalidated.
+  void close();
+
+  /// Retrieve next line from file. The last line is returned even if there is no end of line.
+  /// \param[out] nextLine    Next line (without end of line).
+  /// \return 0 on success, -1 at end of file (or if no file opened)
+  int getNextLine(std::string& nextLine);
+
+  /// Retrieve next line from file, without copy. See getNextLine() above.
+  /// The line is valid until close() in mapped mode, and until next call retrieving lines in chunks mode.
+  int getNextLine(std::string_view& nextLine);
+
+  /// Retrieve next lines from file, without copy: all lines remaining in mapped mode, lines of next chunk in chunks mode.
+  /// The lines are valid until close() in mapped mode, and until next call retrieving lines in chunks mode.
+  /// \param[out] lines       Lines, appended to the vector.
+  /// \return number of lines retrieved, 0 at end of file
+  size_t getLines(std::vector<std::string_view>& lines);
+
+  /// Split a file in parts of similar size, aligned on ends of lines, e.g. to process it in parallel.
+  /// Each part (except maybe the last one) ends with an end of line. There may be less parts than requested, for small files.
+  /// \param[in] path        path to the file
+  /// \param[in] nParts      number of parts requested
+  /// \param[out] parts      parts of the file, in order. Previous content is cleared.
+  /// \return 0 on success, -1 on error (errno is set)
+  static int splitFile(const char* path, size_t nParts, std::vector<FilePart>& parts);
+
+ private:
+  /// Read next chunk of file in buffer, in chunks mode
+  /// \return as read(): number of bytes read, 0 if EOF, -1 on error
+  ssize_t readChunk();
+
+  const size_t chunkSize = 4 * 1024 * 1024; // size of each read, in chunks mode
+
+  int fd = -1;                        // file descriptor
+  void* mapAddress = nullptr;         // mapping of the file, in mapped mode
+  size_t mapSize = 0;                 // size of the mapping
+  const char* data = nullptr;         // data to be read, in mapped mode
+  size_t dataSize = 0;                // size of data
+  size_t dataPos = 0;                 // position of next line in data
+  std::unique_ptr<LineBuffer> chunks; // buffer, in chunks mode
+  off_t remaining = 0;                // number of bytes left to read from file, in chunks mode (-1 if not known)
+  bool isEndOfFile = false;           // set when all data read, in chunks mode
+};
@@ -19,8 +19,31 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <atomic>
+#include <charconv>
+#include <initializer_list>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
+// Minimum severity of messages compiled in the code when using the SIMPLELOG_xxx() macros defined below.
+// Messages of lower severity are removed at compile time (arguments are not evaluated).
+// Values match the SimpleLog::Severity enum: 0 = Trace, 1 = Debug, 2 = Info, 3 = Warning, 4 = Error.
+// By default, trace messages are removed in release builds (NDEBUG defined).
+#ifndef SIMPLELOG_MIN_SEVERITY
+#ifdef NDEBUG
+#define SIMPLELOG_MIN_SEVERITY 1
+#else
+#define SIMPLELOG_MIN_SEVERITY 0
+#endif
+#endif
+
+// Logging methods (trace, debug, info, warning, error) are thread-safe: a SimpleLog object can be shared by any number of threads.
+// Configuration methods (setLogFile, setFileDescriptors, setOutputFormat) can be called while other threads are logging.
 class SimpleLog
 {
 
@@ -38,9 +61,32 @@ class SimpleLog
   // \param rotateMaxBytes Maximum file size, after which a new file is created. If zero, no limit.
   // \param rotateMaxFiles Maximum number of files to keep (including the "current" file). If zero, no limit. If one, a single file is created and cleared immediately, and messages are discarded after reaching rotateMaxBytes.
   // \param rotateNow If non-zero, the file is immediately rotated (independently of its size), otherwise it is appended.
+  // When rotation is enabled, the next file is created in advance by a background thread (as logFilePath.next.pid.instance.N),
+  // so that a rotation only switches file descriptor. The rotated file is then renamed in background: for a short time after a rotation,
+  // logFilePath still refers to the previous file. If a rotation was interrupted (e.g. process crash), its temporary files
+  // (logFilePath.pending.pid.instance.N, logFilePath.next.pid.instance.N) are put back in order when the file is set again,
+  // by modification time, provided the process which created them is not running anymore.
   int setLogFile(const char* logFilePath = NULL,
                  unsigned long rotateMaxBytes = 0, unsigned int rotateMaxFiles = 0, unsigned int rotateNow = 0);
 
+  // list of possible compression methods for rotated log files
+  enum RotateCompression { RotateNoCompression,
+                           RotateGzip, // using external gzip command, rotated files end with .gz
+                           RotateZstd  // using external zstd command, rotated files end with .zst
+  };
+
+  // Set compression of log files after rotation (none by default).
+  // Rotated files are renamed and compressed by a background thread. Compression is done after renaming, and is not waited for by setLogFile().
+  // The exit status of the compression command is used to check its success. If the application ignores SIGCHLD (SIG_IGN), it is not available:
+  // gzip output is then checked from its trailer, and zstd compression is not possible (files are kept uncompressed, and a warning is logged).
+  void setLogRotateCompression(RotateCompression compression);
+
+  // Set a time-based rotation of the log file, in addition to the size limit given in setLogFile() (rotateMaxFiles also applies).
+  // Periods are aligned on local midnight, e.g. 3600 rotates the file every hour on the hour, and 86400 every day at midnight.
+  // \param period Rotation period, in seconds. If zero, disabled (default).
+  // Rotated files are renamed in background, see setLogFile() for the files left by an interrupted rotation.
+  void setLogRotatePeriod(unsigned int period);
+
   // Change file descriptors used for stdout/stderr with provided ones
   // They must be valid for the lifetime of this object (or until overwritten), and are not closed.
   void setFileDescriptors(int fdStdout, int fdStderr);
@@ -49,12 +95,109 @@ class SimpleLog
     ShowTimeStamp = 0x1,
     ShowSeverityTxt = 0x2,
     ShowSeveritySymbol = 0x4,
-    ShowMessage = 0x8
+    ShowMessage = 0x8,
+    CoarseTimeStamp = 0x10, // use a faster clock source for the timestamp, with a few milliseconds resolution (CLOCK_REALTIME_COARSE)
+    OutputJSON = 0x20,      // structured output, one JSON object per line (see below)
+    OutputLogfmt = 0x40     // structured output, one line of key=value pairs per message (logfmt)
   };
+  // In structured output, each message has the fields: time, severity, pid, tid, thread (name), msg,
+  // followed by the common fields (see setCommonFields()) and the fields of the message (see log()).
+  // Other format options are ignored, except CoarseTimeStamp.
 
   // Set output format based on (possibly OR-ed) format options from FormatOption enum
   void setOutputFormat(int opts);
 
+  // Enable buffered output: messages are accumulated in memory and written together with a single system call,
+  // when the buffer is full, when the oldest message in buffer reaches the flush timeout, or immediately after an error message.
+  // Log file rotation still happens on message boundaries.
+  // \param bufferSize   Size of the buffer, in bytes. If zero, buffering is disabled (default) and each message is written immediately.
+  // \param flushTimeout Maximum time a message can stay in buffer, in milliseconds.
+  void setOutputBuffer(unsigned int bufferSize = 4096, unsigned int flushTimeout = 1000);
+
+  // Send messages to a local datagram socket (e.g. /dev/log, or the one of a log collector), instead of log file or stdout/stderr.
+  // Messages are framed with the syslog protocol: "<priority>timestamp identifier[pid]: message".
+  // Sending is non-blocking: when the service is not available or not keeping up, messages are dropped.
+  // The number of dropped messages is reported periodically.
+  // \param socketPath  Path of the Unix-domain datagram socket. If NULL, socket output is disabled (default).
+  // \param identifier  Tag of messages. If NULL, program name is used.
+  // \param facility    Syslog facility code, as defined in syslog.h (default: LOG_USER).
+  // \return 0 on success, -1 on error.
+  int setSocketOutput(const char* socketPath = "/dev/log", const char* identifier = NULL, int facility = (1 << 3));
+
+  // Enable memory-mapped output for the log file: messages are copied directly into a shared mapping of the file,
+  // which is preallocated and extended by large steps. The file is truncated to its content when closed or rotated.
+  // While it is open, its size on disk may be larger than its content (followed by zero bytes).
+  // Output buffering (see setOutputBuffer()) is not used in this mode. It does not apply to stdout/stderr.
+  // \param mapStep   Size by which the mapping is extended, in bytes. If zero, memory-mapped output is disabled (default).
+  // \return 0 on success, -1 on error.
+  int setOutputMapped(size_t mapStep = 64 * 1024 * 1024);
+
+  // Limit the rate of messages logged from each call site, identified by the message format string.
+  // Messages above the limit are suppressed, and their number is reported periodically.
+  // \param maxRate   Maximum average number of messages per second for each call site. If zero, no limit (default).
+  // \param burst     Number of messages accepted in a burst above the average rate.
+  void setRateLimit(unsigned int maxRate, unsigned int burst = 10);
+
+  // Enable suppression of consecutive identical messages.
+  // Repetitions are counted, and reported with a "last message repeated N times" message.
+  void setDuplicatesSuppression(bool enabled);
+
+  // Write all pending messages (buffered or deferred) to output. Blocking call.
+  void flush();
+
+  // list of possible message severity levels, by increasing order of severity
+  enum Severity { Trace,
+                  Debug,
+                  Info,
+                  Warning,
+                  Error };
+
+  // Set minimum severity of messages logged. Messages with a lower severity are discarded, before being formatted
+  // (unless recorded by the flight recorder, see enableFlightRecorder()).
+  // Default is Info.
+  void setLogLevel(Severity minSeverity);
+
+  // Enable the flight recorder: messages of this instance with severity >= minSeverity are kept in an in-memory ring,
+  // even when below the log level (see setLogLevel()) and not written to output.
+  // The ring is shared by all instances of the process. Its content is written to dumpFilePath
+  // on a fatal signal (SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT), followed by a stack trace, or when dumpSignal is received.
+  // Previous handlers of fatal signals are called after the dump.
+  // \param dumpFilePath  File where the ring content is written (overwritten on each dump).
+  // \param minSeverity   Minimum severity of messages recorded.
+  // \param nMessages     Number of messages kept in ring. Used only on first call in the process. Long messages are truncated (500 bytes).
+  // \param dumpSignal    Signal requesting a dump (e.g. kill -USR1). If zero, none.
+  // \return 0 on success, -1 on error.
+  int enableFlightRecorder(const char* dumpFilePath, Severity minSeverity = Severity::Debug, unsigned int nMessages = 4096, int dumpSignal = SIGUSR1);
+
+  // Stop recording messages of this instance in the flight recorder.
+  void disableFlightRecorder();
+
+  // Write the content of the flight recorder to a file descriptor, oldest messages first. Async-signal-safe.
+  // \return 0 on success, -1 on error.
+  static int dumpFlightRecorder(int fd);
+
+  // counters of messages processed by this instance, since its creation
+  struct Stats {
+    static constexpr int nSeverities = Severity::Error + 1;
+    unsigned long messages[nSeverities]; // number of messages written to output, for each severity (indexed by Severity)
+    unsigned long bytes[nSeverities];    // number of bytes written to output, for each severity
+    unsigned long writeFailures;         // number of messages which could not be written (I/O error, socket unavailable, rotation stopped), or of failed flushes of output buffer on timeout
+    unsigned long dropped;               // number of deferred messages dropped because buffer of logging thread was full
+    unsigned long suppressed;            // number of messages suppressed by rate limit or duplicates suppression
+    unsigned long truncations;           // number of messages truncated in the flight recorder
+  };
+
+  // Get the counters of messages processed. Values are updated without synchronization, and may be slightly behind.
+  // Buffered messages are counted when added to the buffer, deferred messages when formatted by the background thread (see flush()).
+  Stats getStats() const;
+
+  // Check if messages of given severity are currently logged.
+  // Can be used to skip the preparation of expensive arguments. See also the SIMPLELOG_xxx() macros.
+  bool isEnabled(Severity severity) const
+  {
+    return (int)severity >= logLevel.load(std::memory_order_relaxed);
+  }
+
   // Log an info message.
   // The message is formatted with timestamp and severity.
   //
@@ -68,6 +211,75 @@ class SimpleLog
   // Log a warning message. See info().
   int warning(const char* message, ...) __attribute__((format(printf, 2, 3)));
 
+  // Log a debug message. See info().
+  int debug(const char* message, ...) __attribute__((format(printf, 2, 3)));
+
+  // Log a trace message. See info().
+  int trace(const char* message, ...) __attribute__((format(printf, 2, 3)));
+
+  // Log a message with given severity. See info().
+  int log(Severity severity, const char* message, ...) __attribute__((format(printf, 3, 4)));
+
+  // a key/value pair associated with a message
+  struct Field {
+    const char* key;
+    const char* value;
+  };
+
+  // Log a message with given severity, and a list of key/value pairs. See info().
+  // In structured output, they are added as separate fields. Otherwise, they are appended to the message as key=value.
+  // e.g. theLog.log(SimpleLog::Severity::Info, { { "run", "123" }, { "detector", "TPC" } }, "Run started");
+  int log(Severity severity, std::initializer_list<Field> fields, const char* message, ...) __attribute__((format(printf, 4, 5)));
+
+  // Set a list of key/value pairs added to all messages in structured output (e.g. facility, hostname).
+  // It replaces the previous list. Strings are copied.
+  void setCommonFields(std::initializer_list<Field> fields);
+
+  // Log a message with a {}-style format: each {} is replaced by the next argument ({{ and }} for literal braces).
+  // Arguments may be integers, floating point numbers, bool, characters, pointers, C strings, std::string or std::string_view.
+  // The format is wrapped with the SIMPLELOG_FORMAT() macro, so that it is parsed and checked against the arguments at compile time,
+  // and numbers are converted with std::to_chars(), e.g.:
+  //   theLog.logFormat(SimpleLog::Severity::Info, SIMPLELOG_FORMAT("run {} started with {} events"), runNumber, nEvents);
+  // See also the SIMPLELOG_xxxF() macros.
+  template <typename Format, typename... Args>
+  int logFormat(Severity severity, Format format, const Args&... args);
+
+  // Same as logFormat(), with the format string literal given again before the arguments (ignored).
+  // Used by the SIMPLELOG_xxxF() macros, which can then be called without arguments after the format.
+  template <typename Format, typename... Args>
+  int logFormatLiteral(Severity severity, Format format, const char*, const Args&... args)
+  {
+    return logFormat(severity, format, args...);
+  }
+
+  // Log an info message, with deferred formatting.
+  // This is a fast path for high rate logging: the format string pointer, a timestamp and a binary copy of the arguments
+  // are stored in a buffer owned by the calling thread. Messages are formatted and written later by a background thread.
+  // Messages logged by different threads are ordered by timestamp, but they may be written after messages logged with info(), warning(), error().
+  //
+  // \param format Message, in a printf-like compatible format (with associated extra arguments).
+  // The format string is not copied: it must be valid for the lifetime of this object (e.g. a string literal).
+  // Arguments may be integers, floating point numbers, pointers, C strings or std::string. Strings are copied.
+  // \return 0 on success, -1 if the message was dropped because the buffer of calling thread is full.
+  template <typename... Args>
+  int infoDeferred(const char* format, const Args&... args);
+
+  // Log an error message, with deferred formatting. See infoDeferred().
+  template <typename... Args>
+  int errorDeferred(const char* format, const Args&... args);
+
+  // Log a warning message, with deferred formatting. See infoDeferred().
+  template <typename... Args>
+  int warningDeferred(const char* format, const Args&... args);
+
+  // Log a debug message, with deferred formatting. See infoDeferred().
+  template <typename... Args>
+  int debugDeferred(const char* format, const Args&... args);
+
+  // Log a trace message, with deferred formatting. See infoDeferred().
+  template <typename... Args>
+  int traceDeferred(const char* format, const Args&... args);
+
   // explicitely disable automatically generated methods
   // disable copy constructor
   SimpleLog(const SimpleLog&) = delete;
@@ -77,7 +289,317 @@ class SimpleLog
  private:
   class Impl;                  // private class for implementation
   std::unique_ptr<Impl> pImpl; // handle to private class instance at runtime
+  std::atomic<int> logLevel;   // minimum severity of messages processed (for output or flight recorder)
+
+  // binary encoding of deferred messages arguments: 1 byte type, followed by value
+  enum DeferredArgType : char { DeferredArgInt,     // followed by 1 byte size of original type, and 8 bytes value
+                                DeferredArgUInt,    // followed by 1 byte size of original type, and 8 bytes value
+                                DeferredArgDouble,  // followed by 8 bytes value
+                                DeferredArgPointer, // followed by 8 bytes value
+                                DeferredArgString   // followed by 4 bytes length, and string content (not zero-terminated)
+  };
+
+  // number of bytes needed to encode an argument of deferred message
+  template <typename T>
+  static size_t deferredArgSize(const T& arg);
+
+  // encode an argument of deferred message, returns pointer to next byte after encoded argument
+  template <typename T>
+  static char* deferredArgEncode(char* p, const T& arg);
+
+  // reserve space for a deferred message in buffer of calling thread.
+  // \param p   Pointer to reserved space for arguments (by reference). NULL when message should not be logged.
+  // \return    0 on success, -1 if no space left.
+  int deferredReserve(Severity severity, const char* format, size_t argsSize, char*& p);
+
+  // publish message previously reserved with deferredReserve()
+  void deferredCommit();
+
+  // base function for deferred logging
+  template <typename... Args>
+  int logDeferred(Severity severity, const char* format, const Args&... args);
+
+  // list of parts of a {}-style format, created at compile time
+  template <size_t N>
+  struct FormatParts {
+    struct Part {
+      unsigned int begin = 0;  // position of literal text in format
+      unsigned int length = 0; // length of literal text
+      bool isArgument = false; // set for a {} placeholder
+    };
+    Part parts[N] = {};
+    unsigned int nParts = 0;
+    unsigned int nArguments = 0;
+    bool isValid = true; // cleared if format contains a single { or }
+  };
+
+  // parse a {}-style format
+  // \param N  Maximum number of parts (format length + 1).
+  template <size_t N>
+  static constexpr FormatParts<N> parseFormat(std::string_view format);
+
+  // an argument of a {}-style format, converted to text
+  struct FormatArgument {
+    char buffer[32];       // storage for text of numbers
+    std::string_view text; // argument text
+  };
+
+  // convert an argument of a {}-style format to text
+  template <typename T>
+  static void formatArgument(FormatArgument& argument, const T& value);
+
+  // log a message made of pieces of text, see logFormat()
+  // \param format    Message format, identifying the call site.
+  // \param pieces    Content of the message.
+  // \param nPieces   Number of pieces.
+  int logPieces(Severity severity, const char* format, const std::string_view* pieces, size_t nPieces);
 };
 
+template <typename T>
+size_t SimpleLog::deferredArgSize(const T& arg)
+{
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+    return 1 + sizeof(uint32_t) + ((arg == nullptr) ? strlen("(null)") : strlen(arg));
+  } else if constexpr (std::is_same_v<U, std::string>) {
+    return 1 + sizeof(uint32_t) + arg.size();
+  } else if constexpr (std::is_floating_point_v<U>) {
+    return 1 + sizeof(double);
+  } else if constexpr (std::is_integral_v<U> || std::is_enum_v<U>) {
+    return 2 + sizeof(uint64_t);
+  } else {
+    static_assert(std::is_pointer_v<U>, "unsupported argument type for deferred logging");
+    return 1 + sizeof(uint64_t);
+  }
+}
+
+template <typename T>
+char* SimpleLog::deferredArgEncode(char* p, const T& arg)
+{
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*> || std::is_same_v<U, std::string>) {
+    const char* str;
+    uint32_t len;
+    if constexpr (std::is_same_v<U, std::string>) {
+      str = arg.data();
+      len = (uint32_t)arg.size();
+    } else {
+      str = (arg == nullptr) ? "(null)" : arg;
+      len = (uint32_t)strlen(str);
+    }
+    *(p++) = DeferredArgString;
+    memcpy(p, &len, sizeof(len));
+    p += sizeof(len);
+    memcpy(p, str, len);
+    p += len;
+  } else if constexpr (std::is_floating_point_v<U>) {
+    double v = (double)arg;
+    *(p++) = DeferredArgDouble;
+    memcpy(p, &v, sizeof(v));
+    p += sizeof(v);
+  } else if constexpr (std::is_integral_v<U> || std::is_enum_v<U>) {
+    bool isSigned;
+    if constexpr (std::is_enum_v<U>) {
+      isSigned = std::is_signed_v<std::underlying_type_t<U>>;
+    } else {
+      isSigned = std::is_signed_v<U>;
+    }
+    uint64_t v = isSigned ? (uint64_t)(int64_t)arg : (uint64_t)arg;
+    *(p++) = isSigned ? DeferredArgInt : DeferredArgUInt;
+    *(p++) = (char)sizeof(U);
+    memcpy(p, &v, sizeof(v));
+    p += sizeof(v);
+  } else {
+    uint64_t v = (uint64_t)(uintptr_t)arg;
+    *(p++) = DeferredArgPointer;
+    memcpy(p, &v, sizeof(v));
+    p += sizeof(v);
+  }
+  return p;
+}
+
+template <typename... Args>
+int SimpleLog::logDeferred(Severity severity, const char* format, const Args&... args)
+{
+  if (!isEnabled(severity)) {
+    return 0;
+  }
+  size_t argsSize = (0 + ... + deferredArgSize(args));
+  char* p = nullptr;
+  int err = deferredReserve(severity, format, argsSize, p);
+  if (p == nullptr) {
+    return err;
+  }
+  ((p = deferredArgEncode(p, args)), ...);
+  deferredCommit();
+  return 0;
+}
+
+template <size_t N>
+constexpr SimpleLog::FormatParts<N> SimpleLog::parseFormat(std::string_view format)
+{
+  FormatParts<N> result;
+  size_t begin = 0;
+  auto addText = [&](size_t end) {
+    if (end > begin) {
+      result.parts[result.nParts].begin = (unsigned int)begin;
+      result.parts[result.nParts].length = (unsigned int)(end - begin);
+      result.nParts++;
+    }
+  };
+  size_t i = 0;
+  while (i < format.size()) {
+    char c = format[i];
+    char next = (i + 1 < format.size()) ? format[i + 1] : 0;
+    if (((c == '{') && (next == '{')) || ((c == '}') && (next == '}'))) {
+      // escaped brace: keep first one
+      addText(i + 1);
+      i += 2;
+      begin = i;
+    } else if ((c == '{') && (next == '}')) {
+      addText(i);
+      result.parts[result.nParts].isArgument = true;
+      result.nParts++;
+      result.nArguments++;
+      i += 2;
+      begin = i;
+    } else {
+      if ((c == '{') || (c == '}')) {
+        result.isValid = false;
+      }
+      i++;
+    }
+  }
+  addText(format.size());
+  return result;
+}
+
+template <typename T>
+void SimpleLog::formatArgument(FormatArgument& argument, const T& value)
+{
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+    argument.text = (value == nullptr) ? "(null)" : value;
+  } else if constexpr (std::is_same_v<U, std::string> || std::is_same_v<U, std::string_view>) {
+    argument.text = value;
+  } else if constexpr (std::is_same_v<U, bool>) {
+    argument.text = value ? "true" : "false";
+  } else if constexpr (std::is_same_v<U, char>) {
+    argument.buffer[0] = value;
+    argument.text = std::string_view(argument.buffer, 1);
+  } else if constexpr (std::is_integral_v<U> || std::is_floating_point_v<U>) {
+    auto result = std::to_chars(argument.buffer, argument.buffer + sizeof(argument.buffer), value);
+    argument.text = std::string_view(argument.buffer, result.ptr - argument.buffer);
+  } else if constexpr (std::is_enum_v<U>) {
+    formatArgument(argument, (std::underlying_type_t<U>)value);
+  } else {
+    static_assert(std::is_pointer_v<U>, "unsupported argument type for logFormat()");
+    argument.buffer[0] = '0';
+    argument.buffer[1] = 'x';
+    auto result = std::to_chars(argument.buffer + 2, argument.buffer + sizeof(argument.buffer), (uintptr_t)value, 16);
+    argument.text = std::string_view(argument.buffer, result.ptr - argument.buffer);
+  }
+}
+
+template <typename Format, typename... Args>
+int SimpleLog::logFormat(Severity severity, Format, const Args&... args)
+{
+  constexpr std::string_view format = Format::get();
+  constexpr FormatParts<format.size() + 1> parts = parseFormat<format.size() + 1>(format);
+  static_assert(parts.isValid, "invalid format: single { or } (use {{ and }} for literal braces)");
+  static_assert(parts.nArguments == sizeof...(Args), "number of {} in format does not match number of arguments");
+
+  if (!isEnabled(severity)) {
+    return 0;
+  }
+
+  FormatArgument arguments[sizeof...(Args) + 1];
+  size_t ix = 0;
+  ((formatArgument(arguments[ix++], args)), ...);
+
+  std::string_view pieces[parts.nParts + 1];
+  ix = 0;
+  for (unsigned int i = 0; i < parts.nParts; i++) {
+    if (parts.parts[i].isArgument) {
+      pieces[i] = arguments[ix++].text;
+    } else {
+      pieces[i] = format.substr(parts.parts[i].begin, parts.parts[i].length);
+    }
+  }
+  return logPieces(severity, format.data(), pieces, parts.nParts);
+}
+
+template <typename... Args>
+int SimpleLog::infoDeferred(const char* format, const Args&... args)
+{
+  return logDeferred(Severity::Info, format, args...);
+}
+
+template <typename... Args>
+int SimpleLog::errorDeferred(const char* format, const Args&... args)
+{
+  return logDeferred(Severity::Error, format, args...);
+}
+
+template <typename... Args>
+int SimpleLog::warningDeferred(const char* format, const Args&... args)
+{
+  return logDeferred(Severity::Warning, format, args...);
+}
+
+template <typename... Args>
+int SimpleLog::debugDeferred(const char* format, const Args&... args)
+{
+  return logDeferred(Severity::Debug, format, args...);
+}
+
+template <typename... Args>
+int SimpleLog::traceDeferred(const char* format, const Args&... args)
+{
+  return logDeferred(Severity::Trace, format, args...);
+}
+
+// Macros to log a message with a given severity, e.g. SIMPLELOG_DEBUG(theLog, "value = %d", computeValue());
+// The message is discarded at compile time if severity is lower than SIMPLELOG_MIN_SEVERITY,
+// and at runtime if it is lower than the log level set for the SimpleLog object.
+// In both cases, the arguments are not evaluated.
+#define SIMPLELOG_LOG(simpleLog, severity, ...)                                           \
+  do {                                                                                    \
+    if (((int)(severity) >= SIMPLELOG_MIN_SEVERITY) && (simpleLog).isEnabled(severity)) { \
+      (simpleLog).log(severity, __VA_ARGS__);                                             \
+    }                                                                                     \
+  } while (0)
+
+// Wrap a {}-style format string literal for SimpleLog::logFormat(), so that it can be checked at compile time.
+#define SIMPLELOG_FORMAT(format)                                 \
+  [] {                                                           \
+    struct SimpleLogFormat {                                     \
+      static constexpr std::string_view get() { return format; } \
+    };                                                           \
+    return SimpleLogFormat{};                                    \
+  }()
+
+// Macros to log a message with a given severity and a {}-style format, e.g. SIMPLELOG_INFOF(theLog, "value = {}", computeValue());
+// See SimpleLog::logFormat(), and SIMPLELOG_LOG() for compile time and runtime filtering.
+#define SIMPLELOG_LOGF(simpleLog, severity, ...)                                                                        \
+  do {                                                                                                                  \
+    if (((int)(severity) >= SIMPLELOG_MIN_SEVERITY) && (simpleLog).isEnabled(severity)) {                               \
+      (simpleLog).logFormatLiteral(severity, SIMPLELOG_FORMAT(SIMPLELOG_FIRST_ARGUMENT(__VA_ARGS__, 0)), __VA_ARGS__); \
+    }                                                                                                                   \
+  } while (0)
+#define SIMPLELOG_FIRST_ARGUMENT(first, ...) first
+
+#define SIMPLELOG_TRACE(simpleLog, ...) SIMPLELOG_LOG(simpleLog, SimpleLog::Severity::Trace, __VA_ARGS__)
+#define SIMPLELOG_DEBUG(simpleLog, ...) SIMPLELOG_LOG(simpleLog, SimpleLog::Severity::Debug, __VA_ARGS__)
+#define SIMPLELOG_INFO(simpleLog, ...) SIMPLELOG_LOG(simpleLog, SimpleLog::Severity::Info, __VA_ARGS__)
+#define SIMPLELOG_WARNING(simpleLog, ...) SIMPLELOG_LOG(simpleLog, SimpleLog::Severity::Warning, __VA_ARGS__)
+#define SIMPLELOG_ERROR(simpleLog, ...) SIMPLELOG_LOG(simpleLog, SimpleLog::Severity::Error, __VA_ARGS__)
+
+#define SIMPLELOG_TRACEF(simpleLog, ...) SIMPLELOG_LOGF(simpleLog, SimpleLog::Severity::Trace, __VA_ARGS__)
+#define SIMPLELOG_DEBUGF(simpleLog, ...) SIMPLELOG_LOGF(simpleLog, SimpleLog::Severity::Debug, __VA_ARGS__)
+#define SIMPLELOG_INFOF(simpleLog, ...) SIMPLELOG_LOGF(simpleLog, SimpleLog::Severity::Info, __VA_ARGS__)
+#define SIMPLELOG_WARNINGF(simpleLog, ...) SIMPLELOG_LOGF(simpleLog, SimpleLog::Severity::Warning, __VA_ARGS__)
+#define SIMPLELOG_ERRORF(simpleLog, ...) SIMPLELOG_LOGF(simpleLog, SimpleLog::Severity::Error, __VA_ARGS__)
+
 #endif /* SRC_SIMPLE_LOG_H */
 
@@ -20,7 +20,9 @@
 #include <chrono>
 #include <string>
 #include <atomic>
+#include <future>
 #include <thread>
+#include <Common/ThreadOptions.h>
 
 namespace AliceO2
 {
@@ -49,7 +51,10 @@ class Thread
   ~Thread();
 
   /// start thread loop
-  void start();
+  /// Thread options (see setThreadOptions()) are applied in the new thread before the first loop call. The thread name is used by default.
+  /// \param    errorMessage If not null, set with the description of the options which could not be applied, if any.
+  /// \return   0 on success, -1 if some thread options could not be applied (thread is running anyway)
+  int start(std::string* errorMessage = nullptr);
   /// request thread termination
   void stop();
   /// wait thread termination (blocking call)
@@ -59,20 +64,87 @@ class Thread
   /// \returns   name of the thread, as defined at construct time.
   std::string getName();
 
+  /// Set options of the thread (CPU affinity, scheduling, name). To be called before start().
+  /// \param[in]   options          Thread options. If the name is empty, the name given to the constructor is used.
+  void setThreadOptions(const ThreadOptions& options);
+
+  /// Set adaptive backoff when loop is idle, instead of a fixed sleep of loopSleepTime after each idle iteration.
+  /// After consecutive idle iterations, the loop is called again: immediately (nSpin times), then after a CPU pause instruction (nPause times),
+  /// then after yielding the CPU (nYield times), then after a sleep starting at minSleepTime and doubling up to loopSleepTime.
+  /// The backoff is reset when the loop returns Ok. To be called before start().
+  /// \param[in]   nSpin            Number of iterations without waiting.
+  /// \param[in]   nPause           Number of iterations with a CPU pause instruction.
+  /// \param[in]   nYield           Number of iterations with sched_yield().
+  /// \param[in]   minSleepTime     First sleep time (in microseconds). If zero, backoff is disabled.
+  void setIdleBackoff(int nSpin, int nPause, int nYield, int minSleepTime);
+
+  /// Statistics of the thread loop, see getStats()
+  struct Stats {
+    static constexpr int nResults = Error + 1;            // number of possible loop results
+    static constexpr int nHistogramBins = 40;             // number of bins of durationHistogram
+    unsigned long long iterations[nResults];              // number of loop calls, by result (index: CallbackResult)
+    unsigned long long busyTime;                          // time spent in loop calls returning Ok, Done or Error, in nanoseconds
+    unsigned long long idleTime;                          // time spent in loop calls returning Idle and waiting after them, in nanoseconds
+    unsigned long long durationHistogram[nHistogramBins]; // number of loop calls by duration: bin i counts durations in [2^i, 2^(i+1)[ nanoseconds (bin 0 from 0, last bin up to infinity)
+
+    /// Get fraction of time the loop was busy
+    /// \returns   busyTime / (busyTime + idleTime), or 0 if no time accounted
+    double getDutyCycle() const;
+
+    /// Get an upper bound of the loop call duration for a given fraction of the calls, e.g. 0.99 for the 99th percentile
+    /// \param[in]   fraction         Fraction of calls, between 0 and 1.
+    /// \returns     duration in nanoseconds (upper limit of histogram bin), or 0 if no calls
+    unsigned long long getDurationPercentile(double fraction) const;
+  };
+
+  /// Get statistics of the thread loop, since start. Lock-free, can be called from any thread, e.g. to monitor periodically the duty cycle.
+  /// Counters are read one by one while the loop updates them: the snapshot may be slightly inconsistent (e.g. by one iteration).
+  /// \returns   statistics
+  Stats getStats() const;
+
+  /// Interrupt idle sleep, if any, to call the loop immediately.
+  /// To be called by producers when new work is available (e.g. after a push to a Fifo read by the loop). Thread-safe.
+  void wake();
+
  private:
   std::atomic<int> shutdown; // flag set to 1 to request thread termination
   std::atomic<int> running;  // flag set to 1 when thread running
   std::thread* theThread;
 
-  std::string name;  // name of the thread, used in debug printouts
+  std::string name;  // name of the thread, used in debug printouts and as default thread name for the kernel
   int loopSleepTime; // sleep time between 2 loop calls
 
+  ThreadOptions options;          // options applied when thread starts
+  std::promise<int>* startStatus; // result of applying options, set by thread when started
+  std::string startError;         // description of options which could not be applied, set by thread before startStatus
+
+  // idle backoff, see setIdleBackoff()
+  int backoffSpin;     // number of iterations without waiting
+  int backoffPause;    // number of iterations with a CPU pause
+  int backoffYield;    // number of iterations with a yield
+  int backoffMinSleep; // first sleep time, zero when backoff disabled
+
+  // statistics, see getStats(). Written by thread loop only.
+  std::atomic<unsigned long long> statsIterations[Stats::nResults];
+  std::atomic<unsigned long long> statsBusyTime;
+  std::atomic<unsigned long long> statsIdleTime;
+  std::atomic<unsigned long long> statsHistogram[Stats::nHistogramBins];
+
+  // wake-up, see wake()
+  int wakeFd;                           // eventfd used to interrupt sleep, -1 if not available
+  std::atomic<unsigned long> wakeCount; // number of calls to wake()
+  std::atomic<int> sleeping;            // flag set to 1 when thread may be sleeping
+
   CallbackResult (*loopCallback)(void*); // callback provided at create time
   void* loopArg;                         // arg to be passed to callback function
 
   CallbackResult doLoop();           // function called at each thread iteration. Returns a result code.
   static void threadMain(Thread* e); // this is the (internal) thread entry point
 
+  void updateStats(int result, unsigned long long duration); // account a loop call, given its result and duration (in nanoseconds)
+  void idleWait(int nIdle, unsigned long wakeCountBefore);   // wait after the given number of consecutive idle iterations, unless woken up since wakeCountBefore
+  void sleep(int sleepTime, unsigned long wakeCountBefore);  // sleep (in microseconds), unless woken up since wakeCountBefore
+
  private:
   std::chrono::time_point<std::chrono::high_resolution_clock> t0; // time of reset
 };
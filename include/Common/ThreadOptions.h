@@ -0,0 +1,59 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+///
+/// \file    ThreadOptions.h
+/// \brief   Settings of a thread: CPU affinity, scheduling, name
+///
+
+#ifndef COMMON_THREADOPTIONS_H
+#define COMMON_THREADOPTIONS_H
+
+#include <string>
+#include <vector>
+
+namespace AliceO2
+{
+namespace Common
+{
+
+/// \brief   Settings of a thread, applied when it starts (see Thread, BasicThread), or to the calling thread with applyThreadOptions().
+/// Default values leave the corresponding setting unchanged.
+struct ThreadOptions {
+  std::vector<int> cpuSet;    // CPUs on which the thread may run. Not changed if empty.
+  int schedulingPolicy = -1;  // scheduling policy: SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO, SCHED_RR. Not changed if -1.
+  int schedulingPriority = 0; // static priority (1-99), for SCHED_FIFO and SCHED_RR
+  int niceValue = 0;          // nice value (-20 to 19), for other policies. Not changed if 0.
+  std::string name;           // thread name, as seen by the kernel (e.g. in top, ps). Truncated to 15 characters. Not changed if empty.
+};
+
+/// Apply settings to the calling thread.
+/// All settings are tried, even if one fails (e.g. real-time scheduling needs privileges).
+/// \param[in]   options          Settings to apply.
+/// \param[out]  errorMessage     Description of the settings which failed, if any.
+/// \return 0 on success, -1 if any setting failed.
+int applyThreadOptions(const ThreadOptions& options, std::string& errorMessage);
+
+/// Parse a list of CPUs, e.g. "0-3,8,10-11".
+/// \param[in]   list             List of CPUs: comma-separated CPU numbers or ranges.
+/// \param[out]  cpuSet           CPUs in the list. Previous content is cleared.
+/// \return 0 on success, -1 on error
+int parseCpuList(const std::string& list, std::vector<int>& cpuSet);
+
+/// Parse a scheduling policy name: other, batch, idle, fifo, rr (case-insensitive).
+/// \param[in]   name             Name of the policy.
+/// \return policy value (e.g. SCHED_FIFO), or -1 on error
+int parseSchedulingPolicy(const std::string& name);
+
+} // namespace Common
+} // namespace AliceO2
+
+#endif // COMMON_THREADOPTIONS_H
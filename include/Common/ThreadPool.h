@@ -0,0 +1,162 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+///
+/// \file    ThreadPool.h
+/// \brief   Class to implement a work-stealing pool of threads
+///
+
+#ifndef COMMON_THREADPOOL_H
+#define COMMON_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <Common/Thread.h>
+
+namespace AliceO2
+{
+namespace Common
+{
+
+/// \brief   Class to implement a work-stealing pool of threads, to execute many small independent tasks.
+/// Each worker (a Thread loop) has its own queue of tasks: it executes the most recent one first, and when empty,
+/// takes the oldest tasks from the queues of other workers. Tasks submitted from a worker go to its own queue.
+/// Idle workers back off progressively, and are woken up when tasks are submitted.
+class ThreadPool
+{
+ public:
+  /// Constructor. Workers are started immediately.
+  /// \param[in]   nWorkers         Number of workers. If zero, the number of CPUs available.
+  /// \param[in]   name             Name of the pool. Workers are named name-0, name-1, etc.
+  /// \param[in]   workerOptions    Thread options (e.g. CPU affinity) of each worker, by index. Workers without an entry keep defaults.
+  /// \param[out]  errorMessage     If not null, set with the description of the worker options which could not be applied, if any (empty otherwise).
+  /// Workers are running anyway.
+  ThreadPool(int nWorkers = 0, const std::string& name = "pool", const std::vector<ThreadOptions>& workerOptions = {}, std::string* errorMessage = nullptr);
+
+  /// Destructor
+  /// Pending tasks are executed, then workers are stopped.
+  ~ThreadPool();
+
+  /// Submit a task.
+  /// \param[in]   f, args          Function to call, and its arguments. They are stored (moved or copied), and passed to f as rvalues.
+  /// \return      future to get the result of the call (or its exception). If the pool is stopped, the future holds a std::runtime_error.
+  template <typename F, typename... Args>
+  auto submit(F&& f, Args&&... args) -> std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>;
+
+  /// Submit several tasks at once, distributed to all workers.
+  /// \param[in]   tasks            Functions to call.
+  /// \return      future ready when all tasks are done. It holds the first exception thrown by a task, if any.
+  std::future<void> submitBatch(std::vector<std::function<void()>> tasks);
+
+  /// Execute a function on a range of indexes, split in parts executed in parallel. Returns when all are done.
+  /// The calling thread executes tasks while waiting, so it can be called from a task.
+  /// \param[in]   begin, end       Range of indexes [begin, end).
+  /// \param[in]   body             Function called for each part, with the range of indexes [partBegin, partEnd) it should process.
+  /// \param[in]   grainSize        Number of indexes per part. If zero, range is split in 4 parts per worker.
+  /// \return      0 on success, -1 if the pool is stopped (before or while executing). The first exception thrown by body, if any, is rethrown.
+  int parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t grainSize = 0);
+
+  /// Wait until all tasks submitted are done.
+  /// When called from a task, waits until the only ones left are tasks also waiting in waitIdle(), and executes tasks meanwhile.
+  void waitIdle();
+
+  /// Stop the pool: new tasks are rejected, workers are stopped. Called by destructor.
+  /// \param[in]   drain            If true, pending tasks are executed before stopping. Otherwise, they are discarded (their futures get a broken promise error).
+  void stop(bool drain = true);
+
+  /// Set a flag which, when set, makes the pool reject new tasks, e.g. Program::getInterruptFlag() or Daemon::getShutdownFlag().
+  /// Pending tasks are still executed: stop() or destructor then return as soon as they are done.
+  /// \param[in]   flag             Pointer to the flag, or nullptr. It should stay valid until pool is stopped.
+  void setStopFlag(const std::atomic<bool>* flag);
+
+  /// Check if pool accepts new tasks.
+  /// \return      true if stopped (or stop requested by flag)
+  bool isStopped() const;
+
+  /// Get number of workers.
+  /// \return      number of workers
+  int getNumberOfWorkers() const;
+
+  /// Get statistics of a worker loop, see Thread::getStats(). Each executed task counts as a busy iteration.
+  /// \param[in]   index            Index of worker.
+  /// \param[out]  stats            Statistics of the worker.
+  /// \return      0 on success, -1 if invalid index
+  int getWorkerStats(int index, Thread::Stats& stats) const;
+
+ private:
+  using Task = std::function<void()>; // a task to be executed
+  struct Worker;                      // a worker and its queue of tasks, defined in implementation
+
+  /// Add a task to a queue. The task is discarded if pool stopped.
+  /// \return 0 on success, -1 if pool stopped
+  int push(Task task);
+
+  /// Count new tasks, unless pool stopped
+  /// \param[in]   n                Number of tasks.
+  /// \return      0 on success, -1 if pool stopped
+  int addPending(size_t n);
+
+  /// Count tasks done (or discarded), and notify waiters when none left
+  /// \param[in]   n                Number of tasks.
+  void removePending(size_t n);
+
+  /// Execute one pending task, from the queue of the given worker, or stolen from another one.
+  /// \param[in]   index            Index of worker, or -1 if not called from a worker.
+  /// \return      true if a task was executed
+  bool runTask(int index);
+
+  /// Index of worker in this pool executing the calling thread, -1 if none
+  int getCurrentWorker() const;
+
+  std::vector<std::unique_ptr<Worker>> workers; // workers, with their queue
+  std::atomic<unsigned int> nextWorker;         // worker receiving next task submitted from outside the pool
+  std::atomic<size_t> nPending;                 // number of tasks submitted and not yet done
+  std::atomic<size_t> nWaiting;                 // number of tasks executing waitIdle()
+  std::atomic<bool> isStopping;                 // set when new tasks rejected
+  const std::atomic<bool>* stopFlag;            // external flag to stop, if any
+  std::mutex idleLock;                          // lock for idleCondition
+  std::condition_variable idleCondition;        // notified when nPending reaches zero
+
+  static Thread::CallbackResult workerLoop(void* arg); // loop of each worker
+};
+
+template <typename F, typename... Args>
+auto ThreadPool::submit(F&& f, Args&&... args) -> std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+{
+  using R = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+  // arguments are moved to the call, so that move-only types can be used.
+  // std::function needs a copyable object: the packaged task is shared
+  auto call = [f = std::forward<F>(f), args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+    return std::apply(std::move(f), std::move(args));
+  };
+  auto task = std::make_shared<std::packaged_task<R()>>(std::move(call));
+  std::future<R> result = task->get_future();
+  if (push([task]() { (*task)(); })) {
+    std::promise<R> rejected;
+    rejected.set_exception(std::make_exception_ptr(std::runtime_error("ThreadPool stopped")));
+    return rejected.get_future();
+  }
+  return result;
+}
+
+} // namespace Common
+} // namespace AliceO2
+
+#endif // COMMON_THREADPOOL_H
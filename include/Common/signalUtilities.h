@@ -25,21 +25,27 @@
 
 #include <execinfo.h>
 #include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
 
-/// \brief Print all the entries of the stack on stderr
+/// \brief Print all the entries of the stack on stderr (or given file descriptor)
+/// Can be used from a signal handler (no memory allocation, provided backtrace() was called once before).
+/// \param fd File descriptor where to print the stack.
+/// \param maxDepth Maximum number of entries printed (up to 64).
 /// \author Barthelemy von Haller
-void printStack()
+inline void printStack(int fd = 2, int maxDepth = 10)
 {
-  void* array[10];
+  void* array[64];
   int size;
-  size = backtrace(array, 10);
-  backtrace_symbols_fd(array, size, 2);
+  size = backtrace(array, (maxDepth > 64) ? 64 : maxDepth);
+  backtrace_symbols_fd(array, size, fd);
 }
 
 /// \brief Callback for SigSev that will print the stack before returning 1 and exiting.
 /// Usage : signal(SIGSEGV, handler_sigsev);
 /// \author Barthelemy von Haller
-void handler_sigsev(int sig)
+inline void handler_sigsev(int sig)
 {
   fprintf(stderr, "Error: signal %d:\n", sig);
   std::cerr << "Error: signal " << sig << "\n";
@@ -47,7 +53,7 @@ void handler_sigsev(int sig)
   exit(1);
 }
 
-bool keepRunning = true; /// Indicates whether we should continue the execution loop or not.
+inline bool keepRunning = true; /// Indicates whether we should continue the execution loop or not.
 
 /// \brief Callback for interruption signals such as SIGINT and SIGTERM allowing the program to clean itself up.
 /// The variable #keepRunning is available to know that we have not been interrupted. In case it becomes false,
@@ -64,7 +70,7 @@ bool keepRunning = true; /// Indicates whether we should continue the execution
 ///    return EXIT_SUCCESS;
 /// \endcode
 /// \author Barthelemy von Haller
-void handler_interruption(int sig)
+inline void handler_interruption(int sig)
 {
   if (keepRunning) {
     std::cout << "Catched signal " << sig << "\n  Exit the process at the end of this cycle. \n  Press again Ctrl-C to force immediate exit" << std::endl;
@@ -20,11 +20,11 @@
 #include <sys/types.h>
 #include <pwd.h>
 
-static int DaemonsShutdownRequest = 0; // global flag set to 1 to request termination, e.g. on SIGTERM/SIGQUIT signals
+static std::atomic<bool> DaemonsShutdownRequest(false); // global flag set to request termination, e.g. on SIGTERM/SIGQUIT signals
 // signal handler to notify exit request
 static void signalHandler(int)
 {
-  DaemonsShutdownRequest = 1;
+  DaemonsShutdownRequest = true;
 }
 
 // this function is a replacement of the Linux glibc daemon() function, reported deprecated on MacOS
@@ -79,7 +79,8 @@ void print_usage()
   printf("  -o [key]=[value]               Set an optional parameter, defined as a key/value pair.\n");
   printf("                                 Possibly overwritten by corresponding content in configuration file [daemon] section\n");
   printf("                                 Valid keys: isInteractive, idleSleepTime, userName, redirectOutput,\n");
-  printf("                                 logFile, logRotateMaxBytes, logRotateMaxFiles, logRotateNow.\n");
+  printf("                                 logFile, logRotateMaxBytes, logRotateMaxFiles, logRotateNow,\n");
+  printf("                                 cpuSet, schedulingPolicy, schedulingPriority, niceValue, threadName.\n");
   printf("  -h                             This help.\n");
   printf("\n");
 }
@@ -137,6 +138,16 @@ Daemon::Daemon(int argc, char* argv[], DaemonConfigParameters* dConfigParams, st
             params.logRotateMaxFiles = std::stoi(value);
           } else if (key == "logRotateNow") {
             params.logRotateNow = std::stoi(value);
+          } else if (key == "cpuSet") {
+            params.cpuSet = value;
+          } else if (key == "schedulingPolicy") {
+            params.schedulingPolicy = value;
+          } else if (key == "schedulingPriority") {
+            params.schedulingPriority = std::stoi(value);
+          } else if (key == "niceValue") {
+            params.niceValue = std::stoi(value);
+          } else if (key == "threadName") {
+            params.threadName = value;
           } else {
             bool keyOk = 0;
             for (auto const& k : extraCommandLineOptions) {
@@ -174,6 +185,27 @@ Daemon::Daemon(int argc, char* argv[], DaemonConfigParameters* dConfigParams, st
     config.getOptionalValue<int>(cfgEntryPoint + ".logRotateMaxBytes", params.logRotateMaxBytes);
     config.getOptionalValue<int>(cfgEntryPoint + ".logRotateMaxFiles", params.logRotateMaxFiles);
     config.getOptionalValue<int>(cfgEntryPoint + ".logRotateNow", params.logRotateNow);
+    config.getOptionalValue<std::string>(cfgEntryPoint + ".cpuSet", params.cpuSet);
+    config.getOptionalValue<std::string>(cfgEntryPoint + ".schedulingPolicy", params.schedulingPolicy);
+    config.getOptionalValue<int>(cfgEntryPoint + ".schedulingPriority", params.schedulingPriority);
+    config.getOptionalValue<int>(cfgEntryPoint + ".niceValue", params.niceValue);
+    config.getOptionalValue<std::string>(cfgEntryPoint + ".threadName", params.threadName);
+
+    // check thread options
+    if (AliceO2::Common::parseCpuList(params.cpuSet, threadOptions.cpuSet)) {
+      log.error("Invalid CPU set %s", params.cpuSet.c_str());
+      throw __LINE__;
+    }
+    if (params.schedulingPolicy.length() > 0) {
+      threadOptions.schedulingPolicy = AliceO2::Common::parseSchedulingPolicy(params.schedulingPolicy);
+      if (threadOptions.schedulingPolicy < 0) {
+        log.error("Invalid scheduling policy %s", params.schedulingPolicy.c_str());
+        throw __LINE__;
+      }
+    }
+    threadOptions.schedulingPriority = params.schedulingPriority;
+    threadOptions.niceValue = params.niceValue;
+    threadOptions.name = params.threadName;
 
     // open log file, if configured
     if (params.logFile.length() > 0) {
@@ -191,6 +223,13 @@ Daemon::Daemon(int argc, char* argv[], DaemonConfigParameters* dConfigParams, st
     }
     log.info("Started PID %d", getpid());
 
+    // set thread options of main loop, before changing user (it may remove the privileges needed)
+    std::string threadOptionsError;
+    if (AliceO2::Common::applyThreadOptions(threadOptions, threadOptionsError)) {
+      log.error("Failed to set thread options: %s", threadOptionsError.c_str());
+      throw __LINE__;
+    }
+
     // set daemon user name
     if (params.userName.length() > 0) {
       int success = 0;
@@ -268,6 +307,11 @@ bool Daemon::isOk()
   return isInitialized;
 }
 
+const std::atomic<bool>& Daemon::getShutdownFlag()
+{
+  return DaemonsShutdownRequest;
+}
+
 // dummy base doLoop() class
 Daemon::LoopStatus Daemon::doLoop()
 {
@@ -16,14 +16,206 @@
 ///
 
 #include <Common/LineBuffer.h>
-#include <sys/select.h>
-#include <sys/time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LINEBUFFER_X86
+#endif
 
-LineBuffer::LineBuffer()
+// Search functions for a byte (end of line) in a buffer.
+// For each implementation:
+// - findByte() finds the first occurrence, with the same semantics as memchr().
+// - findAllBytes() finds all occurrences, processing blocks of 64 bytes at once, which is faster for short lines.
+//   It stores up to maxPositions offsets in positions, and sets scanned to the number of bytes of data fully scanned.
+//   It returns the number of occurrences found.
+
+static const char* findByteMemchr(const char* data, size_t size, char c)
+{
+  return (const char*)memchr(data, c, size);
+}
+
+static size_t findAllBytesMemchr(const char* data, size_t size, char c, size_t* positions, size_t maxPositions, size_t& scanned)
+{
+  size_t n = 0;
+  size_t i = 0;
+  while ((n < maxPositions) && (i < size)) {
+    const char* p = (const char*)memchr(data + i, c, size - i);
+    if (p == NULL) {
+      i = size;
+      break;
+    }
+    positions[n++] = p - data;
+    i = p - data + 1;
+  }
+  scanned = i;
+  return n;
+}
+
+// scan bytes one by one, for the end of the buffer (less than a block), starting at offset i with n positions already found
+static size_t findAllBytesTail(const char* data, size_t size, char c, size_t* positions, size_t maxPositions, size_t& scanned, size_t i, size_t n)
+{
+  for (; (i < size) && (n < maxPositions); i++) {
+    if (data[i] == c) {
+      positions[n++] = i;
+    }
+  }
+  scanned = i;
+  return n;
+}
+
+#ifdef LINEBUFFER_X86
+// process 16 bytes at a time, then remaining bytes one by one
+__attribute__((target("sse2"))) static const char* findByteSSE2(const char* data, size_t size, char c)
+{
+  const __m128i pattern = _mm_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern));
+    if (mask != 0) {
+      return data + i + __builtin_ctz(mask);
+    }
+  }
+  for (; i < size; i++) {
+    if (data[i] == c) {
+      return data + i;
+    }
+  }
+  return NULL;
+}
+
+__attribute__((target("sse2"))) static size_t findAllBytesSSE2(const char* data, size_t size, char c, size_t* positions, size_t maxPositions, size_t& scanned)
+{
+  const __m128i pattern = _mm_set1_epi8(c);
+  size_t n = 0;
+  size_t i = 0;
+  for (; (i + 64 <= size) && (n + 64 <= maxPositions); i += 64) {
+    uint64_t mask = 0;
+    for (int j = 0; j < 4; j++) {
+      __m128i block = _mm_loadu_si128((const __m128i*)(data + i + j * 16));
+      mask |= ((uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern))) << (j * 16);
+    }
+    while (mask != 0) {
+      positions[n++] = i + __builtin_ctzll(mask);
+      mask &= mask - 1;
+    }
+  }
+  if (i + 64 <= size) {
+    // no space left for positions of next block
+    scanned = i;
+    return n;
+  }
+  return findAllBytesTail(data, size, c, positions, maxPositions, scanned, i, n);
+}
+
+// process 64 bytes at a time, then remaining bytes with SSE2
+__attribute__((target("avx2"))) static const char* findByteAVX2(const char* data, size_t size, char c)
+{
+  const __m256i pattern = _mm256_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    __m256i match0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), pattern);
+    __m256i match1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i + 32)), pattern);
+    __m256i match = _mm256_or_si256(match0, match1);
+    if (!_mm256_testz_si256(match, match)) {
+      uint64_t mask = (uint64_t)(unsigned int)_mm256_movemask_epi8(match0) | ((uint64_t)(unsigned int)_mm256_movemask_epi8(match1) << 32);
+      return data + i + __builtin_ctzll(mask);
+    }
+  }
+  return findByteSSE2(data + i, size - i, c);
+}
+
+__attribute__((target("avx2"))) static size_t findAllBytesAVX2(const char* data, size_t size, char c, size_t* positions, size_t maxPositions, size_t& scanned)
+{
+  const __m256i pattern = _mm256_set1_epi8(c);
+  size_t n = 0;
+  size_t i = 0;
+  for (; (i + 64 <= size) && (n + 64 <= maxPositions); i += 64) {
+    __m256i match0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), pattern);
+    __m256i match1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i + 32)), pattern);
+    __m256i match = _mm256_or_si256(match0, match1);
+    if (_mm256_testz_si256(match, match)) {
+      continue;
+    }
+    uint64_t mask = (uint64_t)(unsigned int)_mm256_movemask_epi8(match0) | ((uint64_t)(unsigned int)_mm256_movemask_epi8(match1) << 32);
+    while (mask != 0) {
+      positions[n++] = i + __builtin_ctzll(mask);
+      mask &= mask - 1;
+    }
+  }
+  if (i + 64 <= size) {
+    // no space left for positions of next block
+    scanned = i;
+    return n;
+  }
+  return findAllBytesTail(data, size, c, positions, maxPositions, scanned, i, n);
+}
+#endif
+
+// an implementation of the search functions
+struct ScanFunctions {
+  const char* (*findByte)(const char* data, size_t size, char c);
+  size_t (*findAllBytes)(const char* data, size_t size, char c, size_t* positions, size_t maxPositions, size_t& scanned);
+};
+
+static const ScanFunctions scanMemchr = { findByteMemchr, findAllBytesMemchr };
+#ifdef LINEBUFFER_X86
+static const ScanFunctions scanSSE2 = { findByteSSE2, findAllBytesSSE2 };
+static const ScanFunctions scanAVX2 = { findByteAVX2, findAllBytesAVX2 };
+#endif
+
+// get the search functions for given method
+// \return functions, or NULL if not supported on this CPU
+static const ScanFunctions* getScanFunctions(LineBuffer::ScanMethod method)
+{
+#ifdef LINEBUFFER_X86
+  // may be called before constructors, CPU features need to be initialized
+  __builtin_cpu_init();
+#endif
+  switch (method) {
+    case LineBuffer::ScanMethod::ScanAuto:
+#ifdef LINEBUFFER_X86
+      if (__builtin_cpu_supports("avx2")) {
+        return &scanAVX2;
+      }
+      if (__builtin_cpu_supports("sse2")) {
+        return &scanSSE2;
+      }
+#endif
+      return &scanMemchr;
+    case LineBuffer::ScanMethod::ScanMemchr:
+      return &scanMemchr;
+#ifdef LINEBUFFER_X86
+    case LineBuffer::ScanMethod::ScanSSE2:
+      return __builtin_cpu_supports("sse2") ? &scanSSE2 : NULL;
+    case LineBuffer::ScanMethod::ScanAVX2:
+      return __builtin_cpu_supports("avx2") ? &scanAVX2 : NULL;
+#endif
+    default:
+      break;
+  }
+  return NULL;
+}
+
+// search functions used, selected at startup
+static const ScanFunctions* scanFunctions = getScanFunctions(LineBuffer::ScanMethod::ScanAuto);
+
+static const size_t minReadSize = 4096; // minimum space available in buffer for a read from file descriptor
+
+LineBuffer::LineBuffer(size_t bufferSize)
 {
+  buffer.resize((bufferSize > 0) ? bufferSize : 1);
 }
 
 LineBuffer::~LineBuffer()
@@ -32,84 +224,899 @@ LineBuffer::~LineBuffer()
 
 int LineBuffer::appendFromFileDescriptor(int fd, int timeout)
 {
-  fd_set rfds;
+  struct pollfd pfd;
   int ret;
-  struct timeval tv;
-
-  const int bufferSize = 1000; // size of chunks read from file descriptor
-  char buffer[bufferSize];
 
   for (;;) {
 
-    // wait new data until timeout, if any
-    FD_ZERO(&rfds);
-    FD_SET(fd, &rfds);
-    if (timeout >= 0) {
-      tv.tv_sec = timeout / 1000;
-      tv.tv_usec = (timeout - tv.tv_sec * 1000) * 1000;
-      ret = select(fd + 1, &rfds, NULL, NULL, &tv);
-    } else {
-      ret = select(fd + 1, &rfds, NULL, NULL, NULL);
+    // stop reading until lines are retrieved
+    if (isFull()) {
+      stats.blockedReads++;
+      break;
     }
+
+    // wait new data until timeout, if any
+    // (poll() is used rather than select(), which can not handle file descriptors above FD_SETSIZE)
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    ret = poll(&pfd, 1, timeout);
     if (ret == -1) {
       break;
     }
 
-    if (FD_ISSET(fd, &rfds)) {
-      // read data (keep a spare char in buffer for zero-termination)
-      ret = read(fd, buffer, bufferSize - 1);
-
-      // process new chars
-      if (ret > 0) {
-        // add zero-termination
-        buffer[ret] = 0;
-
-        // parse and extract lines from buffer
-        char* ptr = buffer;
-        while (*ptr != 0) {
-          char* endline;
-          // where's the next end of line?
-          endline = strchr(ptr, '\n');
-          if (endline == NULL) {
-            // not found, keep pending chars for next round
-            pendingLine.append(ptr);
-            break;
-          }
-          // add separator at end of line
-          *endline = 0;
-          // append to previous pending buffer
-          pendingLine.append(ptr);
-          // append to vector of completed lines
-          completeLines.push(pendingLine);
-          pendingLine.clear();
-          // iterate with next part
-          ptr = ++endline;
-        }
-      } else if (ret == 0) {
+    if ((ret > 0) && (pfd.revents != 0)) {
+      // read data directly in buffer
+      ret = readFromFileDescriptor(fd);
+      if (ret == 0) {
         return -1;
-      } else {
+      } else if (ret < 0) {
         break;
       }
     } else {
       break;
     }
 
+    // stop when buffer is full rather than growing it, lines should be retrieved first
+    // (e.g. for a regular file, which has always data available)
+    if (buffer.size() - (end - begin) < minReadSize) {
+      break;
+    }
+
     // continue to iterate reading from fd, but don't wait if nothing left
     timeout = 0;
   }
   return 0;
 }
 
+ssize_t LineBuffer::readFromFileDescriptor(int fd)
+{
+  const size_t maxReadSize = 16 * 1024 * 1024; // maximum space reserved at once for a large record
+  // when the size of next record is known, make room for all of it at once (within reason, the size may be corrupted)
+  size_t recordSize = getRecordSize();
+  size_t missing = (recordSize > end - begin) ? recordSize - (end - begin) : 0;
+  reserveSpace(std::max(minReadSize, std::min(missing, maxReadSize)));
+  ssize_t ret = read(fd, buffer.data() + end, buffer.size() - end);
+  if (ret > 0) {
+    end += ret;
+    if ((maxLineLength > 0) || (maxLines > 0)) {
+      checkLimits(end - ret);
+    }
+  }
+  return ret;
+}
+
+void LineBuffer::reserveSpace(size_t size)
+{
+  if (buffer.size() - end >= size) {
+    return;
+  }
+  // move data not retrieved yet to beginning of buffer
+  if (begin > 0) {
+    memmove(buffer.data(), buffer.data() + begin, end - begin);
+    end -= begin;
+    scanPos -= begin;
+    lineStart -= std::min(lineStart, begin);
+    begin = 0;
+  }
+  // grow buffer if still not enough space
+  if (buffer.size() - end < size) {
+    buffer.resize(std::max(buffer.size() * 2, end + size));
+  }
+}
+
+void LineBuffer::appendData(const char* data, size_t size)
+{
+  reserveSpace(size);
+  memcpy(buffer.data() + end, data, size);
+  end += size;
+  if ((maxLineLength > 0) || (maxLines > 0)) {
+    checkLimits(end - size);
+  }
+}
+
+void LineBuffer::flush()
+{
+  if (isDroppingLine) {
+    // end of line being dropped
+    isDroppingLine = false;
+    stats.droppedLines++;
+    return;
+  }
+  // terminate incomplete line, if any. Incomplete records of other framings can not be completed.
+  if ((framing == FramingDelimiter) && (end > begin) && (buffer[end - 1] != delimiter)) {
+    appendData(&delimiter, 1);
+  }
+}
+
+size_t LineBuffer::countLines(size_t from, size_t to, size_t& lastEnd)
+{
+  const size_t maxPositions = 256; // maximum number of ends of lines found per search
+  size_t positions[maxPositions];
+  size_t count = 0;
+  while (from < to) {
+    size_t scanned;
+    size_t n = scanFunctions->findAllBytes(buffer.data() + from, to - from, delimiter, positions, maxPositions, scanned);
+    if (n > 0) {
+      lastEnd = from + positions[n - 1] + 1;
+    }
+    count += n;
+    from += scanned;
+  }
+  return count;
+}
+
+void LineBuffer::initLimits()
+{
+  lineStart = begin;
+  nLines = countLines(begin, end, lineStart);
+  isDroppingLine = false;
+}
+
+void LineBuffer::checkLimits(size_t from)
+{
+  // discard data up to the end of the line being dropped, if any
+  if (isDroppingLine) {
+    const char* endline = scanFunctions->findByte(buffer.data() + from, end - from, delimiter);
+    if (endline == NULL) {
+      end = from;
+      return;
+    }
+    size_t next = endline - buffer.data() + 1;
+    memmove(buffer.data() + from, buffer.data() + next, end - next);
+    end -= next - from;
+    isDroppingLine = false;
+    stats.droppedLines++;
+  }
+
+  bool dropWhenFull = (maxLines > 0) && (maxLinesPolicy == OverflowDrop);
+  if ((maxLineLength == 0) && (!dropWhenFull)) {
+    // only count lines
+    nLines += countLines(from, end, lineStart);
+    return;
+  }
+
+  // check lines one by one. Data may be moved, so search again from start of incomplete line.
+  scanPos = std::min(scanPos, lineStart);
+  size_t pos = from;
+  while (pos < end) {
+    if (dropWhenFull && (nLines >= maxLines)) {
+      // buffer full: discard incomplete line and new data
+      size_t lastEnd = 0;
+      stats.droppedLines += countLines(pos, end, lastEnd);
+      isDroppingLine = (buffer[end - 1] != delimiter);
+      end = lineStart;
+      return;
+    }
+
+    const char* endline = scanFunctions->findByte(buffer.data() + pos, end - pos, delimiter);
+    size_t lineEnd = (endline == NULL) ? end : endline - buffer.data();
+    size_t length = lineEnd - lineStart;
+
+    if ((maxLineLength > 0) && (length > maxLineLength)) {
+      if (lineLengthPolicy == OverflowDrop) {
+        if (endline == NULL) {
+          // discard data until next end of line
+          end = lineStart;
+          isDroppingLine = true;
+          return;
+        }
+        memmove(buffer.data() + lineStart, buffer.data() + lineEnd + 1, end - lineEnd - 1);
+        end -= length + 1;
+        pos = lineStart;
+        stats.droppedLines++;
+        continue;
+      }
+
+      // split in pieces of maximum length. For an incomplete line, the last piece stays incomplete.
+      size_t nSplits = (length - 1) / maxLineLength;
+      reserveSpace(nSplits); // may move data, lineStart updated
+      size_t tail = lineStart + nSplits * maxLineLength;
+      memmove(buffer.data() + tail + nSplits, buffer.data() + tail, end - tail);
+      for (size_t i = nSplits; i > 0; i--) {
+        size_t src = lineStart + (i - 1) * maxLineLength;
+        size_t dst = src + i - 1;
+        memmove(buffer.data() + dst, buffer.data() + src, maxLineLength);
+        buffer[dst + maxLineLength] = delimiter;
+      }
+      end += nSplits;
+      lineStart += nSplits * (maxLineLength + 1);
+      pos = lineStart;
+      nLines += nSplits;
+      stats.splitLines += nSplits;
+      continue;
+    }
+
+    if (endline == NULL) {
+      break;
+    }
+    nLines++;
+    lineStart = pos = lineEnd + 1;
+  }
+}
+
+int LineBuffer::setMaxLineLength(size_t maxLength, OverflowPolicy policy)
+{
+  if (((policy != OverflowSplit) && (policy != OverflowDrop)) || ((framing != FramingDelimiter) && (maxLength > 0))) {
+    return -1;
+  }
+  maxLineLength = maxLength;
+  lineLengthPolicy = policy;
+  initLimits();
+  return 0;
+}
+
+int LineBuffer::setMaxLines(size_t maxLines, OverflowPolicy policy)
+{
+  if (((policy != OverflowBlock) && (policy != OverflowDrop)) || ((framing != FramingDelimiter) && (maxLines > 0))) {
+    return -1;
+  }
+  this->maxLines = maxLines;
+  maxLinesPolicy = policy;
+  initLimits();
+  return 0;
+}
+
+bool LineBuffer::isFull() const
+{
+  return (maxLines > 0) && (nLines >= maxLines) && (maxLinesPolicy == OverflowBlock);
+}
+
+LineBuffer::Stats LineBuffer::getStats() const
+{
+  return stats;
+}
+
 int LineBuffer::getNextLine(std::string& nextLine)
 {
-  if (completeLines.empty()) {
+  std::string_view line;
+  if (getNextLine(line)) {
     // no complete line yet
     return -1;
   }
   // return next line from buffer (by reference)
-  nextLine = completeLines.front();
-  completeLines.pop();
+  nextLine.assign(line.data(), line.size());
+  return 0;
+}
+
+int LineBuffer::getNextLine(std::string_view& nextLine)
+{
+  if (framing != FramingDelimiter) {
+    return getNextRecord(nextLine);
+  }
+  // where's the next end of line?
+  const char* endline = scanFunctions->findByte(buffer.data() + scanPos, end - scanPos, delimiter);
+  if (endline == NULL) {
+    // not found, no need to search these chars again
+    scanPos = end;
+    return -1;
+  }
+  size_t endPos = endline - buffer.data();
+  nextLine = std::string_view(buffer.data() + begin, endPos - begin);
+  begin = endPos + 1;
+  scanPos = begin;
+  if (nLines > 0) {
+    nLines--;
+  }
+  if (begin == end) {
+    // buffer empty, next data can go at beginning (content is kept until then)
+    begin = end = scanPos = lineStart = 0;
+  }
+  return 0;
+}
+
+size_t LineBuffer::getLines(std::vector<std::string_view>& lines)
+{
+  if (framing != FramingDelimiter) {
+    size_t count = 0;
+    std::string_view record;
+    while (getNextRecord(record) == 0) {
+      lines.push_back(record);
+      count++;
+    }
+    return count;
+  }
+  const size_t maxPositions = 256; // maximum number of ends of lines found per search
+  size_t positions[maxPositions];
+  size_t count = 0;
+  while (scanPos < end) {
+    size_t scanned;
+    size_t n = scanFunctions->findAllBytes(buffer.data() + scanPos, end - scanPos, delimiter, positions, maxPositions, scanned);
+    for (size_t i = 0; i < n; i++) {
+      size_t endPos = scanPos + positions[i];
+      lines.emplace_back(buffer.data() + begin, endPos - begin);
+      begin = endPos + 1;
+    }
+    count += n;
+    scanPos += scanned;
+  }
+  scanPos = std::max(scanPos, begin);
+  nLines -= std::min(nLines, count);
+  if (begin == end) {
+    // buffer empty, next data can go at beginning (content is kept until then)
+    begin = end = scanPos = lineStart = 0;
+  }
+  return count;
+}
+
+int LineBuffer::setFramingDelimiter(char delimiter)
+{
+  this->delimiter = delimiter;
+  framing = FramingDelimiter;
+  scanPos = begin;
+  initLimits();
+  return 0;
+}
+
+int LineBuffer::setFramingFixedSize(size_t recordSize)
+{
+  if ((recordSize == 0) || (maxLineLength > 0) || (maxLines > 0)) {
+    return -1;
+  }
+  this->recordSize = recordSize;
+  framing = FramingFixedSize;
+  return 0;
+}
+
+int LineBuffer::setFramingLengthPrefix(size_t prefixSize, bool isBigEndian)
+{
+  if (((prefixSize != 1) && (prefixSize != 2) && (prefixSize != 4) && (prefixSize != 8)) || (maxLineLength > 0) || (maxLines > 0)) {
+    return -1;
+  }
+  this->prefixSize = prefixSize;
+  prefixBigEndian = isBigEndian;
+  framing = FramingLengthPrefix;
   return 0;
 }
 
-// void LineBuffer::appendString(const char *s) {}
+size_t LineBuffer::getRecordSize() const
+{
+  if (framing == FramingFixedSize) {
+    return recordSize;
+  }
+  if ((framing != FramingLengthPrefix) || (end - begin < prefixSize)) {
+    return 0;
+  }
+  uint64_t length = 0;
+  const unsigned char* prefix = (const unsigned char*)buffer.data() + begin;
+  for (size_t i = 0; i < prefixSize; i++) {
+    size_t k = prefixBigEndian ? i : prefixSize - 1 - i;
+    length = (length << 8) | prefix[k];
+  }
+  return prefixSize + std::min(length, (uint64_t)(SIZE_MAX - prefixSize));
+}
+
+int LineBuffer::getNextRecord(std::string_view& nextRecord)
+{
+  size_t size = getRecordSize();
+  if ((size == 0) || (end - begin < size)) {
+    return -1;
+  }
+  size_t headerSize = (framing == FramingLengthPrefix) ? prefixSize : 0;
+  nextRecord = std::string_view(buffer.data() + begin + headerSize, size - headerSize);
+  begin += size;
+  scanPos = begin;
+  if (begin == end) {
+    // buffer empty, next data can go at beginning (content is kept until then)
+    begin = end = scanPos = lineStart = 0;
+  }
+  return 0;
+}
+
+int LineBuffer::setScanMethod(ScanMethod method)
+{
+  const ScanFunctions* f = getScanFunctions(method);
+  if (f == NULL) {
+    return -1;
+  }
+  scanFunctions = f;
+  return 0;
+}
+
+LineBufferMultiplexer::LineBufferMultiplexer()
+{
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0) {
+    throw std::runtime_error(std::string("epoll_create1 failed: ") + strerror(errno));
+  }
+}
+
+LineBufferMultiplexer::~LineBufferMultiplexer()
+{
+  close(epollFd);
+}
+
+int LineBufferMultiplexer::addFileDescriptor(int fd)
+{
+  if (sources.find(fd) != sources.end()) {
+    return -1;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    return -1;
+  }
+  auto source = std::make_unique<Source>();
+  applySettings(source->buffer);
+  sources[fd] = std::move(source);
+  return 0;
+}
+
+int LineBufferMultiplexer::removeFileDescriptor(int fd)
+{
+  auto it = sources.find(fd);
+  if (it == sources.end()) {
+    return -1;
+  }
+  if ((!it->second->isClosed) && (!it->second->isPaused)) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+  }
+  if (it->second->isInReadyQueue) {
+    // drop it from the ready list, the file descriptor number may be reused by a new source
+    std::queue<int> remaining;
+    for (; !readyQueue.empty(); readyQueue.pop()) {
+      if (readyQueue.front() != fd) {
+        remaining.push(readyQueue.front());
+      }
+    }
+    readyQueue.swap(remaining);
+  }
+  // keep buffer until next read, the last line returned may point to it
+  addStats(*(it->second));
+  releasedSources.push_back(std::move(it->second));
+  sources.erase(it);
+  return 0;
+}
+
+int LineBufferMultiplexer::appendFromFileDescriptors(int timeout)
+{
+  const int maxEvents = 64; // maximum number of descriptors processed per call
+  struct epoll_event events[maxEvents];
+
+  // sources closed and retrieved can now be destroyed
+  releasedSources.clear();
+
+  int nEvents = epoll_wait(epollFd, events, maxEvents, timeout);
+  if (nEvents < 0) {
+    return (errno == EINTR) ? 0 : -1;
+  }
+
+  for (int i = 0; i < nEvents; i++) {
+    int fd = events[i].data.fd;
+    auto it = sources.find(fd);
+    if (it == sources.end()) {
+      continue;
+    }
+    Source& source = *(it->second);
+
+    // read once, remaining data (if any) is reported again on next call
+    ssize_t ret = source.buffer.readFromFileDescriptor(fd);
+    if ((ret < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+      continue;
+    }
+    if (ret <= 0) {
+      // end of file or error: keep last incomplete line, source removed when all lines retrieved
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+      source.isClosed = true;
+      source.buffer.flush();
+    } else if (source.buffer.isFull()) {
+      // stop polling until lines are retrieved
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+      source.isPaused = true;
+      source.buffer.stats.blockedReads++;
+    }
+    if (!source.isInReadyQueue) {
+      source.isInReadyQueue = true;
+      readyQueue.push(fd);
+    }
+  }
+  return nEvents;
+}
+
+int LineBufferMultiplexer::getNextLine(int& fd, std::string& nextLine)
+{
+  std::string_view line;
+  if (getNextLine(fd, line)) {
+    return -1;
+  }
+  nextLine.assign(line.data(), line.size());
+  return 0;
+}
+
+int LineBufferMultiplexer::getNextLine(int& fd, std::string_view& nextLine)
+{
+  while (!readyQueue.empty()) {
+    int readyFd = readyQueue.front();
+    auto it = sources.find(readyFd);
+    if (it != sources.end()) {
+      Source& source = *(it->second);
+      if (source.buffer.getNextLine(nextLine) == 0) {
+        resumeSource(readyFd, source);
+        fd = readyFd;
+        return 0;
+      }
+      // no more lines for this one
+      source.isInReadyQueue = false;
+      if (source.isClosed) {
+        // keep buffer until next read, the last line returned may point to it
+        closedQueue.push(readyFd);
+        addStats(source);
+        releasedSources.push_back(std::move(it->second));
+        sources.erase(it);
+      }
+    }
+    readyQueue.pop();
+  }
+  return -1;
+}
+
+int LineBufferMultiplexer::getNextClosed(int& fd)
+{
+  if (closedQueue.empty()) {
+    return -1;
+  }
+  fd = closedQueue.front();
+  closedQueue.pop();
+  return 0;
+}
+
+size_t LineBufferMultiplexer::getNumberOfFileDescriptors() const
+{
+  return sources.size();
+}
+
+int LineBufferMultiplexer::setFramingDelimiter(char delimiter)
+{
+  if (settings.setFramingDelimiter(delimiter)) {
+    return -1;
+  }
+  applySettings();
+  return 0;
+}
+
+int LineBufferMultiplexer::setFramingFixedSize(size_t recordSize)
+{
+  if (settings.setFramingFixedSize(recordSize)) {
+    return -1;
+  }
+  applySettings();
+  return 0;
+}
+
+int LineBufferMultiplexer::setFramingLengthPrefix(size_t prefixSize, bool isBigEndian)
+{
+  if (settings.setFramingLengthPrefix(prefixSize, isBigEndian)) {
+    return -1;
+  }
+  applySettings();
+  return 0;
+}
+
+int LineBufferMultiplexer::setMaxLineLength(size_t maxLength, LineBuffer::OverflowPolicy policy)
+{
+  if (settings.setMaxLineLength(maxLength, policy)) {
+    return -1;
+  }
+  applySettings();
+  return 0;
+}
+
+int LineBufferMultiplexer::setMaxLines(size_t maxLines, LineBuffer::OverflowPolicy policy)
+{
+  if (settings.setMaxLines(maxLines, policy)) {
+    return -1;
+  }
+  applySettings();
+  return 0;
+}
+
+LineBuffer::Stats LineBufferMultiplexer::getStats() const
+{
+  LineBuffer::Stats total = removedStats;
+  for (const auto& it : sources) {
+    LineBuffer::Stats s = it.second->buffer.getStats();
+    total.droppedLines += s.droppedLines;
+    total.splitLines += s.splitLines;
+    total.blockedReads += s.blockedReads;
+  }
+  return total;
+}
+
+void LineBufferMultiplexer::applySettings()
+{
+  for (auto& it : sources) {
+    applySettings(it.second->buffer);
+    resumeSource(it.first, *(it.second));
+  }
+}
+
+void LineBufferMultiplexer::applySettings(LineBuffer& buffer)
+{
+  // limits removed first, they may not be compatible with the new framing
+  buffer.setMaxLineLength(0);
+  buffer.setMaxLines(0);
+  if (settings.framing == LineBuffer::FramingFixedSize) {
+    buffer.setFramingFixedSize(settings.recordSize);
+  } else if (settings.framing == LineBuffer::FramingLengthPrefix) {
+    buffer.setFramingLengthPrefix(settings.prefixSize, settings.prefixBigEndian);
+  } else {
+    buffer.setFramingDelimiter(settings.delimiter);
+  }
+  buffer.setMaxLineLength(settings.maxLineLength, settings.lineLengthPolicy);
+  buffer.setMaxLines(settings.maxLines, settings.maxLinesPolicy);
+}
+
+void LineBufferMultiplexer::addStats(const Source& source)
+{
+  LineBuffer::Stats s = source.buffer.getStats();
+  removedStats.droppedLines += s.droppedLines;
+  removedStats.splitLines += s.splitLines;
+  removedStats.blockedReads += s.blockedReads;
+}
+
+void LineBufferMultiplexer::resumeSource(int fd, Source& source)
+{
+  if ((!source.isPaused) || (source.buffer.isFull())) {
+    return;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+    source.isPaused = false;
+  }
+}
+
+LineFileReader::LineFileReader()
+{
+}
+
+LineFileReader::~LineFileReader()
+{
+  close();
+}
+
+int LineFileReader::open(const char* path, ReadMode mode, const FilePart* part)
+{
+  close();
+
+  fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close();
+    errno = err;
+    return -1;
+  }
+  bool isRegular = S_ISREG(st.st_mode);
+  if (mode == ReadAuto) {
+    mode = ReadChunks;
+  }
+
+  // range of file to be read
+  off_t offset = 0;
+  off_t size = isRegular ? st.st_size : -1;
+  if (part != nullptr) {
+    if ((part->offset < 0) || (part->size < 0) || ((size >= 0) && (part->offset + part->size > size))) {
+      close();
+      errno = EINVAL;
+      return -1;
+    }
+    offset = part->offset;
+    size = part->size;
+  }
+
+  if (mode == ReadMapped) {
+    if (size < 0) {
+      close();
+      errno = EINVAL;
+      return -1;
+    }
+    if (size > 0) {
+      // mapping must start on a page boundary
+      off_t mapOffset = offset & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+      mapSize = offset + size - mapOffset;
+      mapAddress = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, mapOffset);
+      if (mapAddress == MAP_FAILED) {
+        int err = errno;
+        mapAddress = nullptr;
+        close();
+        errno = err;
+        return -1;
+      }
+      madvise(mapAddress, mapSize, MADV_SEQUENTIAL);
+      data = (const char*)mapAddress + (offset - mapOffset);
+      dataSize = size;
+    }
+    dataPos = 0;
+    return 0;
+  }
+
+  if (offset > 0) {
+    if (lseek(fd, offset, SEEK_SET) != offset) {
+      int err = errno;
+      close();
+      errno = err;
+      return -1;
+    }
+  }
+  if (isRegular) {
+    posix_fadvise(fd, offset, size, POSIX_FADV_SEQUENTIAL);
+  }
+  chunks = std::make_unique<LineBuffer>(2 * chunkSize);
+  remaining = size;
+  isEndOfFile = false;
+  return 0;
+}
+
+void LineFileReader::close()
+{
+  if (mapAddress != nullptr) {
+    munmap(mapAddress, mapSize);
+    mapAddress = nullptr;
+  }
+  mapSize = 0;
+  data = nullptr;
+  dataSize = 0;
+  dataPos = 0;
+  chunks = nullptr;
+  remaining = 0;
+  isEndOfFile = false;
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+ssize_t LineFileReader::readChunk()
+{
+  size_t size = chunkSize;
+  if (remaining >= 0) {
+    size = std::min(size, (size_t)remaining);
+    if (size == 0) {
+      return 0;
+    }
+  }
+  chunks->reserveSpace(size);
+  ssize_t ret = read(fd, chunks->buffer.data() + chunks->end, size);
+  if (ret > 0) {
+    chunks->end += ret;
+    if (remaining >= 0) {
+      remaining -= ret;
+    }
+  }
+  return ret;
+}
+
+int LineFileReader::getNextLine(std::string& nextLine)
+{
+  std::string_view line;
+  if (getNextLine(line)) {
+    return -1;
+  }
+  nextLine.assign(line.data(), line.size());
+  return 0;
+}
+
+int LineFileReader::getNextLine(std::string_view& nextLine)
+{
+  if (chunks == nullptr) {
+    // mapped mode
+    if (dataPos >= dataSize) {
+      return -1;
+    }
+    const char* endline = scanFunctions->findByte(data + dataPos, dataSize - dataPos, '\n');
+    size_t endPos = (endline != NULL) ? endline - data : dataSize;
+    nextLine = std::string_view(data + dataPos, endPos - dataPos);
+    dataPos = endPos + 1;
+    return 0;
+  }
+
+  for (;;) {
+    if (chunks->getNextLine(nextLine) == 0) {
+      return 0;
+    }
+    if (isEndOfFile) {
+      return -1;
+    }
+    if (readChunk() <= 0) {
+      // last line may have no end of line
+      isEndOfFile = true;
+      chunks->flush();
+    }
+  }
+}
+
+size_t LineFileReader::getLines(std::vector<std::string_view>& lines)
+{
+  if (chunks == nullptr) {
+    // mapped mode
+    const size_t maxPositions = 256; // maximum number of ends of lines found per search
+    size_t positions[maxPositions];
+    size_t count = 0;
+    size_t scanPos = dataPos;
+    while (scanPos < dataSize) {
+      size_t scanned;
+      size_t n = scanFunctions->findAllBytes(data + scanPos, dataSize - scanPos, '\n', positions, maxPositions, scanned);
+      for (size_t i = 0; i < n; i++) {
+        size_t endPos = scanPos + positions[i];
+        lines.emplace_back(data + dataPos, endPos - dataPos);
+        dataPos = endPos + 1;
+      }
+      count += n;
+      scanPos += scanned;
+    }
+    if (dataPos < dataSize) {
+      // last line without end of line
+      lines.emplace_back(data + dataPos, dataSize - dataPos);
+      dataPos = dataSize;
+      count++;
+    }
+    return count;
+  }
+
+  for (;;) {
+    size_t count = chunks->getLines(lines);
+    if ((count > 0) || (isEndOfFile)) {
+      return count;
+    }
+    if (readChunk() <= 0) {
+      isEndOfFile = true;
+      chunks->flush();
+    }
+  }
+}
+
+int LineFileReader::splitFile(const char* path, size_t nParts, std::vector<FilePart>& parts)
+{
+  parts.clear();
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    ::close(fd);
+    errno = err;
+    return -1;
+  }
+  off_t size = st.st_size;
+  nParts = std::max(nParts, (size_t)1);
+
+  // each part ends after the first end of line found from its nominal end
+  const size_t blockSize = 64 * 1024; // size of blocks read to search ends of lines
+  std::vector<char> block(blockSize);
+  off_t start = 0;
+  for (size_t i = 1; (i < nParts) && (start < size); i++) {
+    off_t pos = std::max(start, (off_t)(size * i / nParts) - 1);
+    off_t partEnd = size;
+    while (pos < size) {
+      ssize_t n = pread(fd, block.data(), blockSize, pos);
+      if (n <= 0) {
+        int err = (n < 0) ? errno : EIO;
+        ::close(fd);
+        parts.clear();
+        errno = err;
+        return -1;
+      }
+      const char* endline = scanFunctions->findByte(block.data(), n, '\n');
+      if (endline != NULL) {
+        partEnd = pos + (endline - block.data()) + 1;
+        break;
+      }
+      pos += n;
+    }
+    parts.push_back({ start, partEnd - start });
+    start = partEnd;
+  }
+  if ((start < size) || (parts.empty())) {
+    parts.push_back({ start, size - start });
+  }
+  ::close(fd);
+  return 0;
+}
@@ -10,17 +10,630 @@
 // or submit itself to any jurisdiction.
 
 #include <Common/SimpleLog.h>
+#include <Common/signalUtilities.h>
 
 #include <time.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
 #include <dirent.h>
+#include <errno.h>
+#include <limits.h>
 #include <vector>
 #include <ctype.h>
 #include <string.h>
 #include <algorithm>
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <map>
+#include <deque>
+#include <chrono>
+
+extern char** environ; // environment passed to external commands
+
+// identification of a thread, for structured output
+struct SimpleLogThreadInfo {
+  pid_t pid = 0;      // process id
+  pid_t tid = 0;      // thread id (as given by gettid)
+  char name[16] = ""; // thread name (as given by pthread_getname_np)
+};
+
+// header of a deferred message record
+// it is followed by the encoded arguments (see SimpleLog::deferredArgEncode)
+struct SimpleLogDeferredRecord {
+  uint32_t size;     // size of record in bytes, including this header and padding
+  uint32_t severity; // message severity. A value of paddingMark is used for empty space to be skipped at the end of buffer.
+  const char* format;
+  uint64_t timeNs; // time at which message was logged, in nanoseconds since epoch
+
+  static const uint32_t paddingMark = 0xFFFFFFFF;
+};
+
+// buffer to pass deferred messages from a logging thread to the backend thread
+// lock-free, for 1 writer and 1 reader
+class SimpleLogDeferredBuffer
+{
+ public:
+  SimpleLogDeferredBuffer(size_t size) : data(size), head(0), tail(0), writerExited(false) {}
+
+  // reserve a contiguous area of size bytes (multiple of 8) for writing.
+  // \param newHead   value to be set for head on commit (by reference)
+  // \return          pointer to reserved area, or NULL if not enough space available.
+  char* reserve(size_t size, uint64_t& newHead)
+  {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint64_t t = tail.load(std::memory_order_acquire);
+    size_t pos = h % data.size();
+    size_t contiguous = data.size() - pos;
+    size_t needed = (size > contiguous) ? contiguous + size : size;
+    if (h - t + needed > data.size()) {
+      return nullptr;
+    }
+    if (size > contiguous) {
+      // not enough space at end of buffer: mark remaining bytes to be skipped, and wrap
+      SimpleLogDeferredRecord* padding = (SimpleLogDeferredRecord*)&data[pos];
+      padding->size = (uint32_t)contiguous;
+      padding->severity = SimpleLogDeferredRecord::paddingMark;
+      h += contiguous;
+      pos = 0;
+    }
+    newHead = h + size;
+    return &data[pos];
+  }
+
+  // publish data previously reserved
+  void commit(uint64_t newHead) { head.store(newHead, std::memory_order_release); }
+
+  // number of bytes used in buffer
+  size_t getUsedSize() { return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed); }
+
+  std::vector<char> data;         // buffer content
+  std::atomic<uint64_t> head;     // total number of bytes written
+  std::atomic<uint64_t> tail;     // total number of bytes read
+  std::atomic<bool> writerExited; // set when the writer thread does not use this buffer anymore
+  SimpleLogThreadInfo threadInfo; // writer thread identification
+};
+
+// buffer used by the calling thread for deferred messages
+// the buffer belongs to the SimpleLog instance with id instanceId
+struct SimpleLogDeferredThreadCache {
+  unsigned long instanceId = 0;
+  std::shared_ptr<SimpleLogDeferredBuffer> buffer;
+  uint64_t pendingHead = 0; // position of last record reserved, to be committed
+
+  ~SimpleLogDeferredThreadCache()
+  {
+    if (buffer != nullptr) {
+      buffer->writerExited = true;
+    }
+  }
+};
+
+// an argument of a deferred message, decoded from binary buffer (see SimpleLog::deferredArgEncode)
+struct SimpleLogDeferredArg {
+  char type;          // one of SimpleLog::DeferredArgType
+  int size;           // for integers, size in bytes of original type
+  uint64_t value;     // integer and pointer values
+  double valueDouble; // floating point values
+  const char* str;    // string content (not zero-terminated)
+  uint32_t len;       // string length
+};
+
+// a log file rotated, or to be rotated
+struct SimpleLogRotatedFile {
+  unsigned int index; // rotation index: 1 for the most recent rotated file, 0 for the file being rotated
+  std::string path;   // current file path
+  std::string suffix; // compression extension at end of file name (e.g. ".gz"), if any
+};
+
+// a log file rotation to be completed in background
+struct SimpleLogRotateTask {
+  std::string logFilePath;     // path of the log file
+  std::string pendingPath;     // path where the log file was moved, to be renamed with rotation index
+  unsigned int rotateMaxFiles; // maximum number of files to keep
+  std::string nextPath;        // path of the file replacing the log file, moved to logFilePath after it. Empty when none.
+};
+
+// a compression of a rotated file, to be done in background after its rotation
+struct SimpleLogCompressTask {
+  std::string logFilePath; // path of the log file
+  ino_t inode;             // inode of the rotated file, which may be renamed by later rotations before being compressed
+};
+
+// rate limit state of a call site
+// implements a token bucket with the "generic cell rate algorithm", so that it can be updated with a single atomic variable
+struct SimpleLogRateLimitEntry {
+  std::atomic<const char*> format;        // format string identifying the call site, NULL when entry free
+  std::atomic<uint64_t> nextTime;         // theoretical time of next message when bucket is empty, in nanoseconds
+  std::atomic<unsigned long> nSuppressed; // number of messages suppressed since last report
+};
+
+// statistics counters, see SimpleLog::Stats
+// several copies are kept, each one on its own cache line, and logging threads update the one matching their index,
+// so that counting does not add contention between threads
+struct alignas(64) SimpleLogCounters {
+  std::atomic<unsigned long> messages[SimpleLog::Stats::nSeverities];
+  std::atomic<unsigned long> bytes[SimpleLog::Stats::nSeverities];
+  std::atomic<unsigned long> writeFailures;
+  std::atomic<unsigned long> suppressed;
+  std::atomic<unsigned long> truncations;
+};
+
+// index of counters used by calling thread
+static thread_local const unsigned int simpleLogCountersIndex = (unsigned int)std::hash<std::thread::id>()(std::this_thread::get_id());
+
+// a list of key/value pairs, added to all messages in structured output
+struct SimpleLogFieldList {
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+};
+
+// formatting of a message content
+// it may be done several times, e.g. when the message does not fit in the buffer provided
+class SimpleLogFormatter
+{
+ public:
+  // format message in buffer, with the same semantics as vsnprintf()
+  // \param buffer    Output buffer.
+  // \param size      Output buffer size. Output is truncated (and zero-terminated) if needed.
+  // \return          Length of the complete message.
+  virtual int format(char* buffer, size_t size) const = 0;
+};
+
+// formatting of a message from a printf-like format and its arguments
+class SimpleLogPrintfFormatter : public SimpleLogFormatter
+{
+ public:
+  SimpleLogPrintfFormatter(const char* message, va_list args) : message(message) { va_copy(ap, args); }
+  ~SimpleLogPrintfFormatter() { va_end(ap); }
+
+  int format(char* buffer, size_t size) const override
+  {
+    va_list apCopy;
+    va_copy(apCopy, ap);
+    int n = vsnprintf(buffer, size, message, apCopy);
+    va_end(apCopy);
+    return n;
+  }
+
+ private:
+  const char* message; // printf-like format
+  mutable va_list ap;  // arguments
+};
+
+// formatting of a message by concatenation of pieces of text (see SimpleLog::logFormat())
+class SimpleLogPiecesFormatter : public SimpleLogFormatter
+{
+ public:
+  SimpleLogPiecesFormatter(const std::string_view* pieces, size_t nPieces) : pieces(pieces), nPieces(nPieces) {}
+
+  int format(char* buffer, size_t size) const override
+  {
+    size_t ix = 0;
+    for (size_t i = 0; i < nPieces; i++) {
+      if (ix + 1 < size) {
+        size_t n = std::min(pieces[i].size(), size - 1 - ix);
+        memcpy(&buffer[ix], pieces[i].data(), n);
+      }
+      ix += pieces[i].size();
+    }
+    if (size > 0) {
+      buffer[std::min(ix, size - 1)] = 0;
+    }
+    return (int)ix;
+  }
+
+ private:
+  const std::string_view* pieces; // message content
+  size_t nPieces;                 // number of pieces
+};
+
+// a buffer to format a message
+// a buffer on the stack is used for most messages, and a thread-local buffer for larger ones.
+// The latter grows as needed and is kept for reuse, so that there is no memory allocation per message.
+class SimpleLogFormatBuffer
+{
+ public:
+  // \param stackBuffer   Buffer used by default.
+  // \param stackSize     Size of default buffer.
+  // \param overflow      Thread-local buffer used when more space is needed.
+  SimpleLogFormatBuffer(char* stackBuffer, size_t stackSize, std::vector<char>& overflow) : data(stackBuffer), size(stackSize), overflow(overflow) {}
+
+  // make sure the buffer can hold at least newSize bytes. Content is preserved.
+  void reserve(size_t newSize)
+  {
+    if (newSize <= size) {
+      return;
+    }
+    if (overflow.size() < newSize) {
+      overflow.resize(std::max(newSize, 2 * overflow.size()));
+    }
+    if (!isOverflow) {
+      memcpy(overflow.data(), data, size);
+      isOverflow = true;
+    }
+    data = overflow.data();
+    size = overflow.size();
+  }
+
+  char* data;  // current buffer
+  size_t size; // current buffer size
+
+ private:
+  std::vector<char>& overflow; // thread-local buffer
+  bool isOverflow = false;     // set when the thread-local buffer is used
+};
+
+// thread-local buffers for large messages. Separate buffers are used for the formatted message and the output record.
+static thread_local std::vector<char> simpleLogMessageOverflow;
+static thread_local std::vector<char> simpleLogRecordOverflow;
+
+// serialization of a structured message (JSON or logfmt) in a fixed size buffer, without memory allocation
+// fields which do not fit in the buffer are skipped, string values are truncated. The output is always well-formed.
+class SimpleLogSerializer
+{
+ public:
+  // \param buffer    Output buffer.
+  // \param size      Output buffer size.
+  // \param isJSON    If set, output is a JSON object. Otherwise, logfmt.
+  SimpleLogSerializer(char* buffer, size_t size, bool isJSON) : buffer(buffer), limit(size - tailSize), isJSON(isJSON)
+  {
+    if (isJSON) {
+      buffer[ix++] = '{';
+    }
+  }
+
+  // add a string field
+  void addField(const char* key, const char* value, size_t valueLength)
+  {
+    size_t start = ix;
+    if (!putKey(key)) {
+      ix = start;
+      return;
+    }
+    if (isJSON || needsQuotes(value, valueLength)) {
+      if (!put('"')) {
+        ix = start;
+        return;
+      }
+      putEscaped(value, valueLength);
+      buffer[ix++] = '"'; // space was reserved for it
+    } else if (!put(value, valueLength)) {
+      ix = start;
+    }
+  }
+
+  // add a zero-terminated string field
+  void addField(const char* key, const char* value) { addField(key, value, strlen(value)); }
+
+  // add an integer field
+  void addField(const char* key, long value)
+  {
+    char tmp[24];
+    size_t start = ix;
+    if ((!putKey(key)) || (!put(tmp, snprintf(tmp, sizeof(tmp), "%ld", value)))) {
+      ix = start;
+    }
+  }
+
+  // check if some content did not fit in the buffer
+  bool isTruncated() const { return truncated; }
+
+  // maximum number of bytes needed to serialize a field, with worst-case escaping
+  static size_t getMaxSize(size_t keyLength, size_t valueLength) { return 6 * (keyLength + valueLength) + 6; }
+
+  // complete the record with end of line
+  // \return total length of the record
+  size_t end()
+  {
+    if (isJSON) {
+      buffer[ix++] = '}';
+    }
+    buffer[ix++] = '\n';
+    buffer[ix] = 0;
+    return ix;
+  }
+
+ private:
+  static const size_t tailSize = 4; // space reserved to close a record: quote, brace, end of line, zero
+
+  bool put(char c)
+  {
+    if (ix >= limit) {
+      truncated = true;
+      return false;
+    }
+    buffer[ix++] = c;
+    return true;
+  }
+
+  bool put(const char* s, size_t n)
+  {
+    if (ix + n > limit) {
+      truncated = true;
+      return false;
+    }
+    memcpy(&buffer[ix], s, n);
+    ix += n;
+    return true;
+  }
+
+  // write field separator and key
+  bool putKey(const char* key)
+  {
+    if ((!isFirst) && (!put(isJSON ? ',' : ' '))) {
+      return false;
+    }
+    isFirst = false;
+    if (isJSON) {
+      if (!put('"')) {
+        return false;
+      }
+      size_t n = strlen(key);
+      if (putEscaped(key, n) != n) {
+        return false;
+      }
+      return put("\":", 2);
+    }
+    for (const char* k = key; *k != 0; k++) {
+      // characters not allowed in logfmt keys are replaced
+      char c = *k;
+      if ((c <= ' ') || (c == '=') || (c == '"')) {
+        c = '_';
+      }
+      if (!put(c)) {
+        return false;
+      }
+    }
+    return put('=');
+  }
+
+  // check if a logfmt value needs to be quoted
+  static bool needsQuotes(const char* value, size_t n)
+  {
+    if (n == 0) {
+      return true;
+    }
+    for (size_t i = 0; i < n; i++) {
+      unsigned char c = (unsigned char)value[i];
+      if ((c <= ' ') || (c == '=') || (c == '"') || (c == '\\') || (c == 0x7F)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // write string content, with JSON escaping (also used for quoted logfmt values)
+  // escape sequences are never truncated
+  // \return number of input characters written
+  size_t putEscaped(const char* s, size_t n)
+  {
+    size_t i = 0;
+    while (i < n) {
+      // copy characters not needing escaping in one go
+      size_t j = i;
+      while ((j < n) && ((unsigned char)s[j] >= 0x20) && (s[j] != '"') && (s[j] != '\\')) {
+        j++;
+      }
+      if (j > i) {
+        size_t len = j - i;
+        if (ix + len > limit) {
+          len = limit - ix;
+        }
+        memcpy(&buffer[ix], &s[i], len);
+        ix += len;
+        i += len;
+        if (i != j) {
+          truncated = true;
+          return i;
+        }
+      }
+      if (i == n) {
+        break;
+      }
+      char esc[7];
+      size_t escLength = 2;
+      unsigned char c = (unsigned char)s[i];
+      esc[0] = '\\';
+      switch (c) {
+        case '"':
+          esc[1] = '"';
+          break;
+        case '\\':
+          esc[1] = '\\';
+          break;
+        case '\n':
+          esc[1] = 'n';
+          break;
+        case '\r':
+          esc[1] = 'r';
+          break;
+        case '\t':
+          esc[1] = 't';
+          break;
+        default:
+          escLength = snprintf(esc, sizeof(esc), "\\u%04x", c);
+          break;
+      }
+      if (!put(esc, escLength)) {
+        return i;
+      }
+      i++;
+    }
+    return i;
+  }
+
+  char* buffer;           // output buffer
+  size_t limit;           // usable size of output buffer, excluding space reserved for record end
+  size_t ix = 0;          // current position in output buffer
+  bool isJSON;            // output format: JSON if set, logfmt otherwise
+  bool isFirst = true;    // set until first field is written
+  bool truncated = false; // set when some content did not fit
+};
+
+// in-memory ring of the last messages logged, dumped on crash or on request
+// it is shared by all SimpleLog instances of the process. Writers are lock-free, and dump is async-signal-safe.
+class SimpleLogFlightRecorder
+{
+ public:
+  // a message recorded. Its content is valid when sequence is 2 * index + 2 (odd values while being written).
+  struct Slot {
+    std::atomic<uint64_t> sequence; // sequence number, from the index of the message in the ring
+    uint32_t length;                // length of text
+    char text[500];                 // formatted message, including end of line. Longer messages are truncated.
+  };
+
+  // \param nSlots    Number of messages kept in ring.
+  SimpleLogFlightRecorder(unsigned int nSlots) : slots(new Slot[nSlots]), nSlots(nSlots)
+  {
+    for (unsigned int i = 0; i < nSlots; i++) {
+      slots[i].sequence = 0;
+      slots[i].length = 0;
+    }
+  }
+
+  // get a slot to record next message
+  // \param index     Index of message in the ring (by reference), to be given to commit().
+  Slot* reserve(uint64_t& index)
+  {
+    index = next.fetch_add(1, std::memory_order_relaxed);
+    Slot* slot = &slots[index % nSlots];
+    slot->sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return slot;
+  }
+
+  // publish a message written in a slot
+  void commit(Slot* slot, uint64_t index, size_t length)
+  {
+    slot->length = (uint32_t)length;
+    slot->sequence.store(2 * index + 2, std::memory_order_release);
+  }
+
+  // write ring content to a file descriptor, oldest messages first. Async-signal-safe.
+  // \return 0 on success, -1 on error.
+  int dump(int fd)
+  {
+    uint64_t end = next.load(std::memory_order_acquire);
+    uint64_t begin = (end > nSlots) ? end - nSlots : 0;
+    char text[sizeof(Slot::text)];
+    for (uint64_t i = begin; i < end; i++) {
+      Slot* slot = &slots[i % nSlots];
+      if (slot->sequence.load(std::memory_order_acquire) != 2 * i + 2) {
+        // being written, or already overwritten
+        continue;
+      }
+      size_t length = slot->length;
+      if (length > sizeof(text)) {
+        length = sizeof(text);
+      }
+      memcpy(text, slot->text, length);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot->sequence.load(std::memory_order_relaxed) != 2 * i + 2) {
+        continue;
+      }
+      if (write(fd, text, length) != (ssize_t)length) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+ private:
+  std::unique_ptr<Slot[]> slots;   // ring content
+  unsigned int nSlots;             // number of slots in ring
+  std::atomic<uint64_t> next{ 0 }; // index of next message
+};
+
+// the flight recorder of the process, created on first use. It is never deleted, as it may be used by signal handler at any time.
+static std::atomic<SimpleLogFlightRecorder*> simpleLogFlightRecorder(nullptr);
+static std::mutex simpleLogFlightRecorderLock;                  // lock for flight recorder configuration
+static char simpleLogFlightRecorderPath[PATH_MAX] = "";         // file where flight recorder is dumped
+static volatile sig_atomic_t simpleLogFlightRecorderSignal = 0; // signal requesting a dump
+static struct sigaction simpleLogPreviousActions[NSIG];         // signal actions replaced by flight recorder handler
+
+// write a string to a file descriptor. Async-signal-safe.
+static void writeSignalSafe(int fd, const char* s)
+{
+  if (write(fd, s, strlen(s)) < 0) {
+    return;
+  }
+}
+
+// write an integer to a file descriptor. Async-signal-safe.
+static void writeSignalSafe(int fd, int value)
+{
+  char buffer[16];
+  int ix = sizeof(buffer);
+  bool isNegative = (value < 0);
+  unsigned int v = isNegative ? -(unsigned int)value : value;
+  do {
+    buffer[--ix] = '0' + v % 10;
+    v /= 10;
+  } while ((v != 0) && (ix > 1));
+  if (isNegative) {
+    buffer[--ix] = '-';
+  }
+  if (write(fd, &buffer[ix], sizeof(buffer) - ix) < 0) {
+    return;
+  }
+}
+
+// signal handler: dump flight recorder to file
+// on fatal signals, a stack trace is added, and the signal is raised again with the previous action
+static void simpleLogFlightRecorderHandler(int sig)
+{
+  int savedErrno = errno;
+  bool isFatal = (sig != simpleLogFlightRecorderSignal);
+  int fd = open(simpleLogFlightRecorderPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd >= 0) {
+    writeSignalSafe(fd, "SimpleLog flight recorder dump on signal ");
+    writeSignalSafe(fd, sig);
+    writeSignalSafe(fd, "\n");
+    SimpleLog::dumpFlightRecorder(fd);
+    if (isFatal) {
+      writeSignalSafe(fd, "Stack trace:\n");
+      printStack(fd, 64);
+    }
+    close(fd);
+  }
+  if (isFatal) {
+    // delivered when this handler returns
+    sigaction(sig, &simpleLogPreviousActions[sig], NULL);
+    raise(sig);
+  }
+  errno = savedErrno;
+}
+
+// install flight recorder handler for a signal
+// \param isFatal  If set, the handler is removed after first call.
+static void simpleLogSetSignalHandler(int sig, bool isFatal)
+{
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = simpleLogFlightRecorderHandler;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART | (isFatal ? SA_RESETHAND : 0);
+  sigaction(sig, &action, &simpleLogPreviousActions[sig]);
+}
+
+static thread_local SimpleLogDeferredThreadCache simpleLogDeferredThreadCache;
+static std::atomic<unsigned long> simpleLogInstanceCounter(0);
 
 class SimpleLog::Impl
 {
@@ -31,40 +644,433 @@ class SimpleLog::Impl
   // destructor
   ~Impl();
 
-  // list of possible message severity levels
-  enum Severity { Info,
-                  Error,
-                  Warning };
-
   // base log function, with printf-like format arguments
   // \param severity  Message severity.
   // \param message   Message content, printf-like format.
   // \param ap        Variable list of arguments associated with message.
-  int logV(SimpleLog::Impl::Severity severity, const char* message, va_list ap);
+  // \param fields    Optional key/value pairs associated with message.
+  // \param nFields   Number of key/value pairs.
+  int logV(SimpleLog::Severity severity, const char* message, va_list ap, const SimpleLog::Field* fields = nullptr, size_t nFields = 0);
+
+  // base log function, with a message formatter. See logV().
+  // \param callSite  Message format, identifying the call site.
+  // \param formatter Message formatter.
+  int logFormatted(SimpleLog::Severity severity, const char* callSite, const SimpleLogFormatter& formatter, const SimpleLog::Field* fields = nullptr, size_t nFields = 0);
+
+  // format and write a message. See logFormatted().
+  // \param checkDuplicates  If set, the message is discarded when identical to previous one (if duplicates suppression enabled).
+  int writeFormatted(SimpleLog::Severity severity, const SimpleLogFormatter& formatter, bool checkDuplicates, const SimpleLog::Field* fields = nullptr, size_t nFields = 0);
+
+  // serialize and write a message in structured format (JSON or logfmt)
+  // \param severity  Message severity.
+  // \param opts      Format options.
+  // \param ts        Time of the message.
+  // \param thread    Thread which logged the message.
+  // \param message   Message content (formatted).
+  // \param size      Message size.
+  // \param fields    Optional key/value pairs associated with message.
+  // \param nFields   Number of key/value pairs.
+  int writeStructured(SimpleLog::Severity severity, int opts, const struct timespec& ts, const SimpleLogThreadInfo& thread, const char* message, size_t size, const SimpleLog::Field* fields, size_t nFields);
+
+  // log a message generated internally (e.g. statistics), not subject to rate limit and duplicates suppression
+  int logInternal(SimpleLog::Severity severity, const char* message, ...) __attribute__((format(printf, 3, 4)));
+
+  // check rate limit for the call site of a message
+  // \param format    Message format, identifying the call site.
+  // \return          true if message can be logged, false if it should be suppressed.
+  bool checkRateLimit(const char* format);
+
+  // check if message is identical to the previous one. If so, it is counted and should be discarded.
+  // the number of repetitions is reported when a different message is received.
+  // \param severity  Message severity.
+  // \param message   Message content (after prefix).
+  // \param size      Message size.
+  // \return          true if message should be discarded.
+  bool checkDuplicate(SimpleLog::Severity severity, const char* message, size_t size);
+
+  // report number of messages suppressed (rate limit, duplicates)
+  void reportSuppressed();
+
+  // record a message in the flight recorder
+  // \param severity  Message severity.
+  // \param formatter Message formatter.
+  void recordFormatted(SimpleLog::Severity severity, const SimpleLogFormatter& formatter);
+
+  // record a deferred message in the flight recorder
+  void recordDeferred(const SimpleLogDeferredRecord* record);
+
+  // write a formatted message to the output, and rotate log file when needed
+  // can be called concurrently from any thread
+  // \param severity  Message severity.
+  // \param buffer    Formatted message, including end of line.
+  // \param size      Number of bytes in buffer.
+  // \param prefixLength  Length of message prefix (timestamp, severity) in buffer, not sent to socket output (which has its own header).
+  // Statistics counters are updated.
+  int writeMessage(SimpleLog::Severity severity, const char* buffer, size_t size, size_t prefixLength = 0);
+
+  // write a formatted message to the output. See writeMessage().
+  // \return 0 on success, -1 on error, 1 if output is disabled.
+  int writeOutput(SimpleLog::Severity severity, const char* buffer, size_t size, size_t prefixLength);
+
+  // send a message to socket output
+  // \param severity  Message severity.
+  // \param message   Message content (without prefix).
+  // \param size      Message size.
+  // \return 0 on success, -1 if message dropped.
+  int sendSocket(SimpleLog::Severity severity, const char* message, size_t size);
+
+  // format message prefix (timestamp, severity) according to format options
+  // \param buffer    Output buffer.
+  // \param size      Output buffer size.
+  // \param severity  Message severity.
+  // \param opts      Format options.
+  // \param ts        Time of the message. If NULL, current time is used.
+  // \return          Number of characters written.
+  size_t formatPrefix(char* buffer, size_t size, SimpleLog::Severity severity, int opts, const struct timespec* ts);
+
+  // get the buffer for deferred messages of calling thread. It is created on first call.
+  SimpleLogDeferredBuffer* getDeferredBuffer();
+
+  // format and write pending deferred messages, from all threads
+  // \return number of messages processed
+  int processDeferred();
+
+  // format and write a deferred message
+  // \param record    Message to be written.
+  // \param source    Buffer containing the message.
+  void writeDeferred(SimpleLogDeferredRecord* record, const SimpleLogDeferredBuffer* source);
+
+  // format the content of a deferred message, growing the buffer if needed
+  // \param record    Deferred message.
+  // \param buffer    Output buffer.
+  // \param offset    Position in buffer where to write the message. At least 2 bytes are left after message (for end of line).
+  // \return          Message length.
+  size_t formatDeferredRecord(const SimpleLogDeferredRecord* record, SimpleLogFormatBuffer& buffer, size_t offset);
+
+  // decode next argument of a deferred message
+  // \param p     Pointer to encoded argument, updated to next one.
+  // \param end   End of encoded arguments.
+  // \param arg   Decoded argument (by reference).
+  // \return      0 on success, -1 if no argument left.
+  static int decodeDeferredArg(const char*& p, const char* end, SimpleLogDeferredArg& arg);
+
+  // format a deferred message: equivalent of vsnprintf(), with arguments decoded from binary buffer.
+  // Each conversion specification of the format is processed with its matching argument, using the argument type recorded at logging time.
+  // \param buffer    Output buffer.
+  // \param size      Output buffer size.
+  // \param format    Message format.
+  // \param args      Encoded arguments.
+  // \param argsEnd   End of encoded arguments.
+  // \return          Number of characters written (not zero-terminated).
+  static size_t formatDeferredMessage(char* buffer, size_t size, const char* format, const char* args, const char* argsEnd);
+
+  // add a message to the output buffer, and write buffer content when needed
+  // caller must hold fileLock in shared mode
+  // \param severity  Message severity.
+  // \param fdOut     File descriptor where message is to be written.
+  // \param buffer    Formatted message, including end of line.
+  // \param size      Number of bytes in buffer.
+  int writeBuffered(SimpleLog::Severity severity, int fdOut, const char* buffer, size_t size);
+
+  // write output buffer content
+  // caller must have exclusive access to the output buffer (fileLock in exclusive mode, or outputBufferLock)
+  int flushOutputBuffer();
+
+  // release space reserved in the log file for bytes which could not be written, so that its size stays accurate for rotation
+  // caller must hold fileLock
+  // \param fdOut     File descriptor written.
+  // \param size      Number of bytes to be written.
+  // \param nBytes    Number of bytes written, or -1 on error.
+  void releaseFileSpace(int fdOut, size_t size, ssize_t nBytes);
+
+  // write output buffer content if flush timeout reached
+  // \param force     If set, content is written independently of timeout.
+  void checkOutputBuffer(bool force);
+
+  // background thread loop, processing deferred messages and flushing output buffer
+  void backendLoop();
+
+  // start background thread, if not running yet
+  void startBackend();
+
+  // stop background thread, after writing pending messages
+  void stopBackend();
+
+  // wait until background thread has written all pending messages
+  void flushBackend();
 
  protected:
-  FILE* fp; // descriptor to be used. If NULL, using stdout/stderr.
-  int formatOptions;
+  // Concurrency model: messages are formatted in a buffer local to the calling thread,
+  // and written with a single write() call on a file opened in append mode.
+  // Logging threads hold fileLock in shared mode while writing, so they do not serialize with each other.
+  // Changes of the file descriptor (rotation, reconfiguration) are done with fileLock held in exclusive mode.
+  std::shared_mutex fileLock;
+
+  int fd; // file descriptor of log file. If -1, using stdout/stderr.
+  std::atomic<int> formatOptions;
   int fdStdout;
   int fdStderr;
-  bool disableOutput = 0; // when set, messages completely dropped (logfile=/dev/null)
+  std::atomic<bool> disableOutput; // when set, messages completely dropped (logfile=/dev/null)
+
+  // output to a local datagram socket, with syslog protocol
+  int socketFd = -1;                        // socket, -1 when disabled
+  struct sockaddr_un socketAddress;         // address of destination socket
+  std::string socketTag;                    // message tag, "identifier[pid]: "
+  int socketFacility = 0;                   // syslog facility code
+  std::atomic<unsigned long> socketDropped; // number of messages which could not be sent, since last report
 
   // log rotation settings
   unsigned long rotateMaxBytes = 0;
   unsigned int rotateMaxFiles = 0;
-  std::string logFilePath; // need to keep file path for later
-  size_t logFileSize = 0;  // keep track of its size for rotation
+  std::string logFilePath;         // need to keep file path for later
+  std::atomic<size_t> logFileSize; // keep track of its size for rotation. Bytes are reserved here before being written.
+  unsigned long rotateCount = 0;   // number of rotations done, used to detect concurrent rotations
+  std::atomic<size_t> rotateOffset; // offset of first message which did not fit in file before rotation (end of file content)
+  unsigned int rotatePeriod = 0;    // time-based rotation period, in seconds. Zero when disabled.
+  std::atomic<time_t> rotateTime;   // time of next time-based rotation
+
+  // memory-mapped output
+  // a large range of address space is reserved, and the file is mapped in it by steps, so that the mapping never moves
+  static constexpr size_t mapReserveSize = (sizeof(void*) >= 8) ? ((size_t)1 << 40) : ((size_t)1 << 30); // maximum file size mapped
+  size_t mapStep = 0;             // size by which the mapping is extended, in bytes. Zero when disabled.
+  char* mapBase = nullptr;        // start of reserved address range, file mapped from offset 0
+  std::atomic<size_t> mapSize;    // number of bytes of file currently mapped
+  std::mutex mapLock;             // lock to extend mapping
+
+  // output buffer
+  // when enabled, messages are accumulated and written together
+  std::mutex outputBufferLock;                                // lock to access the buffer
+  std::vector<char> outputBuffer;                             // buffer content. Its size is the buffer capacity, zero when disabled.
+  size_t outputBufferUsed = 0;                                // number of bytes used in buffer
+  int outputBufferFd = -1;                                    // file descriptor where buffer content is to be written
+  std::chrono::steady_clock::time_point outputBufferTime;     // time when first message in buffer was added
+  std::chrono::milliseconds outputBufferFlushTimeout{ 1000 }; // maximum time a message stays in buffer
+
+  // rate limit of messages for each call site
+  static const unsigned int rateLimitTableSize = 1024;       // maximum number of call sites tracked
+  static const unsigned int rateLimitMaxProbes = 32;         // maximum number of entries checked to find a call site
+  std::unique_ptr<SimpleLogRateLimitEntry[]> rateLimitTable; // table of call sites (open addressing, indexed by format pointer)
+  std::atomic<uint64_t> rateLimitInterval;                   // average time between 2 messages, in nanoseconds. Zero when no limit.
+  std::atomic<uint64_t> rateLimitBurst;                      // time equivalent of the burst size, in nanoseconds
+
+  // suppression of duplicate messages
+  // the last message state is updated as a whole, with a lock: this path is only used when suppression is enabled
+  std::atomic<bool> duplicatesEnabled; // set when suppression of duplicates enabled
+  std::mutex lastMessageLock;          // lock to access last message state below
+  uint64_t lastMessageHash;            // hash of last message logged
+  int lastMessageSeverity;             // severity of last message logged
+  unsigned long lastMessageRepeat;     // number of times last message was repeated
+
+  // severity levels, see SimpleLog::logLevel
+  std::atomic<int> outputLevel;   // minimum severity of messages written to output
+  std::atomic<int> recorderLevel; // minimum severity of messages recorded in flight recorder. INT_MAX when disabled.
+
+  // statistics
+  static const unsigned int nCounters = 16;      // number of copies of the counters
+  std::unique_ptr<SimpleLogCounters[]> counters; // counters, see SimpleLogCounters
+
+  // get the counters of calling thread
+  SimpleLogCounters& getCounters()
+  {
+    return counters[simpleLogCountersIndex % nCounters];
+  }
+
+  // key/value pairs added to all messages in structured output
+  // previous lists are kept until destruction, so that a list can be used without locking
+  std::mutex commonFieldsLock;                                          // lock to update the list
+  std::vector<std::unique_ptr<SimpleLogFieldList>> commonFieldsHistory; // all lists created
+  std::atomic<const SimpleLogFieldList*> commonFields;                  // current list
 
   void closeLogFile();
-  int openLogFile();
+  // \param isReopen  When set, the file is not truncated (see rotateMaxFiles).
+  int openLogFile(bool isReopen = false);
+
+  // start writing to a newly opened log file
+  // \param newFd     File descriptor of the log file, opened in read-write mode.
+  void useLogFile(int newFd);
+
+  // close current log file and switch to the next one. Must be called with fileLock in exclusive mode.
+  // \return 0 on success, -1 on error (no file open anymore)
+  int rotateLogFile();
+
+  // compute time of next time-based rotation
+  // \param now       Current time.
+  void updateRotateTime(time_t now);
+
+  // map current log file in memory
+  // \return 0 on success, -1 on error
+  int mapLogFile();
+
+  // remove mapping of current log file, and truncate it to its content
+  void unmapLogFile();
+
+  // extend mapping of log file. Must be called with mapLock.
+  // \param minSize   Minimum number of bytes of file to be mapped.
+  // \return 0 on success, -1 on error
+  int extendMapping(size_t minSize);
+
+  // write a message to the mapped log file
+  // \param buffer    Formatted message, including end of line.
+  // \param size      Number of bytes in buffer.
+  // \param offset    Position in file, reserved for this message.
+  int writeMapped(const char* buffer, size_t size, size_t offset);
   void rotate(); // this renames older files
 
+  // log rotation in background
+  // the current file is moved to a temporary name, and a task is queued for the rotation thread,
+  // which renames older files (keeping the list of existing files in memory after a first directory scan) and compresses them if configured.
+  static std::mutex rotateFilesLock;               // lock to access rotated files (list, renaming). Shared by all instances, which may use the same files.
+  std::string rotatedFilesBase;                    // log file path for which rotatedFiles is valid. Empty when a scan is needed.
+  std::vector<SimpleLogRotatedFile> rotatedFiles;  // list of rotated files existing, by increasing index
+  std::thread rotateThread;                        // thread processing rotation tasks
+  std::mutex rotateQueueLock;                      // lock to access queue of rotation tasks
+  std::condition_variable rotateWakeUp;            // used to notify rotation thread of new task, or queue state change
+  std::deque<SimpleLogRotateTask> rotateQueue;     // rotation tasks to be done
+  bool rotateBusy = false;                         // set while rotation thread processes a task
+  std::deque<SimpleLogCompressTask> compressQueue; // compressions to be done, after rotation tasks. Not waited for by waitRotations().
+  bool rotateShutdown = false;                     // flag set to request rotation thread to exit
+  std::atomic<int> rotateCompression;              // compression of rotated files, one of SimpleLog::RotateCompression
+
+  // next log file, created in advance by the rotation thread (see getTemporaryPath()), so that a rotation only switches file descriptor.
+  // The rotation thread then moves the current file aside, and the next file to the log file path.
+  // Protected by rotateQueueLock.
+  int nextFileFd = -1;                      // file descriptor of next file, -1 when not available
+  std::string nextFilePath;                 // path of next file
+  std::string nextFileBase;                 // log file path for which a next file is wanted. Empty when none.
+  bool nextFileRequested = false;           // set to request rotation thread to create a next file
+  std::atomic<unsigned long> nextFileIndex; // counter used to name next files
+
+  // request creation of next log file in background, if rotation enabled. Must be called with fileLock in exclusive mode.
+  void requestNextFile();
+
+  // get next log file, if available
+  // \param path      Path of the file (by reference).
+  // \return          File descriptor, or -1 if not available.
+  int takeNextFile(std::string& path);
+
+  // close and remove next log file, and cancel pending requests
+  void releaseNextFile();
+
+  // start rotation thread, if not running yet. Must be called with rotateQueueLock.
+  void startRotation();
+
+  // get path of a temporary file for the log file, unique to this object in all processes writing to the same path
+  // \param logFilePath     Path of the log file.
+  // \param kind            Kind of temporary file (e.g. "pending").
+  // \param index           Index of the file, unique for this kind in this object.
+  // \return                Path of the temporary file, logFilePath.kind.pid.instanceId.index
+  std::string getTemporaryPath(const std::string& logFilePath, const char* kind, unsigned long index) const;
+
+  // check that the list of rotated files is still valid, i.e. that the files were not renamed by another writer of the same path
+  // \param logFilePath     Path of the log file.
+  // \param files           List of rotated files, sorted by increasing index.
+  // \return                true if each index up to the last one exists if and only if listed, false if a scan is needed.
+  static bool checkRotatedFiles(const std::string& logFilePath, const std::vector<SimpleLogRotatedFile>& files);
+
+  // scan directory for files matching log file path, with rotation index, and possibly compression extension (e.g. file.log.3.gz)
+  // \param logFilePath     Path of the log file.
+  // \param includeCurrent  If set, the log file itself is included in the list (with index 0).
+  // \param files           List of files found, sorted by increasing index (by reference).
+  static void scanRotatedFiles(const std::string& logFilePath, bool includeCurrent, std::vector<SimpleLogRotatedFile>& files);
+
+  // put back in order the files left by an interrupted rotation (e.g. after a crash), in the directory of logFilePath.
+  // Only temporary files (see getTemporaryPath()) of processes which do not exist anymore are considered, files of live writers are left untouched.
+  // Pending and next files are rotated as usual, by modification time. If the log file does not exist, the most recent one takes its place.
+  // Empty next files and partial compressions are removed.
+  // Must be called with fileLock in exclusive mode.
+  void recoverRotatedFiles();
+
+  // rename files to increment their rotation index, starting from 1. Files above maximum index are deleted.
+  // \param logFilePath     Path of the log file.
+  // \param files           List of files to be renamed, sorted by increasing index (by reference). Updated with new names.
+  // \param maxFiles        Maximum number of files to keep (including the current log file). If zero, no limit.
+  static void shiftRotatedFiles(const std::string& logFilePath, std::vector<SimpleLogRotatedFile>& files, unsigned int maxFiles);
+
+  // compress a rotated file, using external command
+  // The file is compressed to a temporary file without holding rotateFilesLock, then replaced by it if still in the list of rotated files.
+  void compressRotatedFile(const SimpleLogCompressTask& task);
+
+  // queue a rotation task, to be done in background
+  void queueRotation(const SimpleLogRotateTask& task);
+
+  // rotation thread loop
+  void rotateLoop();
+
+  // wait until all rotation tasks are completed (compressions excluded)
+  void waitRotations();
+
+  // take fileLock in exclusive mode, once all rotation tasks are completed (compressions excluded).
+  // Waiting is done before locking, so that logging threads are not blocked meanwhile.
+  void lockFileIdle(std::unique_lock<std::shared_mutex>& lock);
+
+  // stop rotation thread, after processing pending tasks
+  void stopRotation();
+
+  // deferred messages
+  // each thread writes to its own buffer, which is read by the backend thread
+  static constexpr size_t deferredBufferSize = 1024 * 1024; // size of buffer for each thread
+  const unsigned long instanceId;                       // unique id of this object, to identify buffers in thread cache
+  std::mutex deferredLock;                              // lock to access the list of buffers
+  unsigned long deferredBuffersVersion = 0;             // incremented each time the list of buffers changes
+  std::atomic<unsigned long> deferredDropped;           // number of messages dropped because buffer full
+  // buffers used by each thread
+  std::map<std::thread::id, std::shared_ptr<SimpleLogDeferredBuffer>> deferredBuffers;
+
+  // background thread
+  std::thread backendThread;
+  std::mutex backendMutex;
+  std::condition_variable backendWakeUp;      // used to wake up backend thread, e.g. when a buffer is getting full
+  bool backendShutdown = false;               // flag set to request backend thread to exit
+  static constexpr int backendIdleSleepTime = 10; // maximum idle time before checking buffers, in milliseconds
+  unsigned long backendBuffersVersion = 0;    // version of deferredBuffers list copied in backendBuffers
+  // copy of deferredBuffers list, used by backend thread
+  std::vector<std::shared_ptr<SimpleLogDeferredBuffer>> backendBuffers;
+  std::condition_variable backendFlushed; // used to notify completion of a flush request
+  unsigned long backendFlushRequest = 0;  // incremented to request backend thread to write all pending messages
+  unsigned long backendFlushDone = 0;     // last flush request completed
+
   friend class SimpleLog;
 };
 
-SimpleLog::Impl::Impl()
+std::mutex SimpleLog::Impl::rotateFilesLock;
+
+SimpleLog::Impl::Impl() : instanceId(++simpleLogInstanceCounter)
 {
-  fp = NULL;
+  rateLimitTable = std::make_unique<SimpleLogRateLimitEntry[]>(rateLimitTableSize);
+  for (unsigned int i = 0; i < rateLimitTableSize; i++) {
+    rateLimitTable[i].format = nullptr;
+    rateLimitTable[i].nextTime = 0;
+    rateLimitTable[i].nSuppressed = 0;
+  }
+  rateLimitInterval = 0;
+  rateLimitBurst = 0;
+  counters = std::make_unique<SimpleLogCounters[]>(nCounters);
+  for (unsigned int i = 0; i < nCounters; i++) {
+    for (int j = 0; j < SimpleLog::Stats::nSeverities; j++) {
+      counters[i].messages[j] = 0;
+      counters[i].bytes[j] = 0;
+    }
+    counters[i].writeFailures = 0;
+    counters[i].suppressed = 0;
+    counters[i].truncations = 0;
+  }
+  duplicatesEnabled = false;
+  lastMessageHash = 0;
+  lastMessageSeverity = 0;
+  lastMessageRepeat = 0;
+  commonFields = nullptr;
+  outputLevel = (int)Severity::Info;
+  recorderLevel = INT_MAX;
+  rotateOffset = SIZE_MAX;
+  rotateTime = 0;
+  nextFileIndex = 0;
+  mapSize = 0;
+  socketDropped = 0;
+  rotateCompression = SimpleLog::RotateCompression::RotateNoCompression;
+  deferredDropped = 0;
+  fd = -1;
+  disableOutput = 0;
+  logFileSize = 0;
   formatOptions = SimpleLog::FormatOption::ShowTimeStamp | SimpleLog::FormatOption::ShowSeveritySymbol | SimpleLog::FormatOption::ShowMessage;
   fdStdout = fileno(stdout);
   fdStderr = fileno(stderr);
@@ -72,227 +1078,1761 @@ SimpleLog::Impl::Impl()
 
 SimpleLog::Impl::~Impl()
 {
+  stopBackend();
   closeLogFile();
+  stopRotation();
+  if (socketFd >= 0) {
+    close(socketFd);
+  }
 }
 
-int SimpleLog::Impl::logV(SimpleLog::Impl::Severity s, const char* message, va_list ap)
+// get current time
+// \param ts            Current time (by reference).
+// \param coarseClock   If set, use a faster clock source with lower resolution (few milliseconds).
+static void getTime(struct timespec& ts, bool coarseClock)
 {
-  // immediate return if output disabled
-  if (disableOutput) {
-    return 0;
+  clockid_t clockId = CLOCK_REALTIME;
+#ifdef CLOCK_REALTIME_COARSE
+  if (coarseClock) {
+    clockId = CLOCK_REALTIME_COARSE;
   }
-
-  char buffer[1024] = "";
-  size_t len = sizeof(buffer) - 2;
+#else
+  (void)coarseClock;
+#endif
+  if (clock_gettime(clockId, &ts) == -1) {
+    ts.tv_sec = time(NULL);
+    ts.tv_nsec = 0;
+  }
+}
+
+// format given time as "YYYY-MM-DD HH:MM:SS.uuuuuu"
+// The date and time part is generated only once per second and per thread, only the microseconds are rendered at each call.
+// \param buffer        Output buffer.
+// \param size          Output buffer size.
+// \param ts            Time to be formatted.
+// \return              Number of characters written (not zero-terminated).
+static size_t formatTimeStamp(char* buffer, size_t size, const struct timespec& ts)
+{
+  static const size_t timeStampLength = 26;
+  thread_local time_t cachedSecond = (time_t)-1; // time for which the date string below was created
+  thread_local char cachedDate[20];              // "YYYY-MM-DD HH:MM:SS"
+
+  if (size < timeStampLength) {
+    return 0;
+  }
+
+  if (ts.tv_sec != cachedSecond) {
+    struct tm tm_str;
+    localtime_r(&ts.tv_sec, &tm_str);
+    if (strftime(cachedDate, sizeof(cachedDate), "%Y-%m-%d %T", &tm_str) != sizeof(cachedDate) - 1) {
+      return 0;
+    }
+    cachedSecond = ts.tv_sec;
+  }
+
+  memcpy(buffer, cachedDate, sizeof(cachedDate) - 1);
+  buffer[19] = '.';
+  unsigned int us = (unsigned int)(ts.tv_nsec / 1000);
+  for (int i = timeStampLength - 1; i >= 20; i--) {
+    buffer[i] = '0' + us % 10;
+    us /= 10;
+  }
+  return timeStampLength;
+}
+
+// get identification of calling thread
+// it is cached, and refreshed once per second (the thread name may change)
+// \param now   Current time, in seconds.
+static const SimpleLogThreadInfo& getThreadInfo(time_t now)
+{
+  thread_local SimpleLogThreadInfo info;
+  thread_local time_t lastUpdate = (time_t)-1;
+  if (now != lastUpdate) {
+    info.pid = getpid();
+    info.tid = (pid_t)syscall(SYS_gettid);
+    if (pthread_getname_np(pthread_self(), info.name, sizeof(info.name)) != 0) {
+      info.name[0] = 0;
+    }
+    lastUpdate = now;
+  }
+  return info;
+}
+
+size_t SimpleLog::Impl::formatPrefix(char* buffer, size_t len, SimpleLog::Severity s, int opts, const struct timespec* ts)
+{
   size_t ix = 0;
 
-  if (formatOptions & SimpleLog::FormatOption::ShowTimeStamp) {
+  if (opts & SimpleLog::FormatOption::ShowTimeStamp) {
     // timestamp (microsecond)
-    struct timeval tv;
-    double fullTimeNow = -1;
-    if (gettimeofday(&tv, NULL) == -1) {
-      fullTimeNow = time(NULL);
-    } else {
-      fullTimeNow = (double)tv.tv_sec + (double)tv.tv_usec / 1000000;
-    }
-    time_t now;
-    struct tm tm_str;
-    now = (time_t)fullTimeNow;
-    localtime_r(&now, &tm_str);
-    double fractionOfSecond = fullTimeNow - now;
-    ix += strftime(&buffer[ix], len - ix, "%Y-%m-%d %T", &tm_str);
-    char str_fractionOfSecond[10];
-    snprintf(str_fractionOfSecond, sizeof(str_fractionOfSecond), "%.6lf", fractionOfSecond);
-    ix += snprintf(&buffer[ix], len - ix, ".%s", &str_fractionOfSecond[2]);
-    if (ix > len) {
-      ix = len;
+    struct timespec now;
+    if (ts == NULL) {
+      getTime(now, opts & SimpleLog::FormatOption::CoarseTimeStamp);
+      ts = &now;
     }
+    ix += formatTimeStamp(&buffer[ix], len - ix, *ts);
   }
 
-  if (formatOptions & SimpleLog::FormatOption::ShowSeveritySymbol) {
+  if (opts & SimpleLog::FormatOption::ShowSeveritySymbol) {
     if (s == Severity::Error) {
       ix += snprintf(&buffer[ix], len - ix, " !!! ");
     } else if (s == Severity::Warning) {
       ix += snprintf(&buffer[ix], len - ix, "  !  ");
+    } else if (s == Severity::Debug) {
+      ix += snprintf(&buffer[ix], len - ix, "  d  ");
+    } else if (s == Severity::Trace) {
+      ix += snprintf(&buffer[ix], len - ix, "  t  ");
     } else {
       ix += snprintf(&buffer[ix], len - ix, "     ");
     }
   }
 
-  if (formatOptions & SimpleLog::FormatOption::ShowSeverityTxt) {
+  if (opts & SimpleLog::FormatOption::ShowSeverityTxt) {
     if (s == Severity::Error) {
       ix += snprintf(&buffer[ix], len - ix, "Error - ");
     } else if (s == Severity::Warning) {
       ix += snprintf(&buffer[ix], len - ix, "Warning - ");
+    } else if (s == Severity::Debug) {
+      ix += snprintf(&buffer[ix], len - ix, "Debug - ");
+    } else if (s == Severity::Trace) {
+      ix += snprintf(&buffer[ix], len - ix, "Trace - ");
     } else {
       // ix+=snprintf(&buffer[ix], len-ix, "");
     }
   }
 
-  if (formatOptions & SimpleLog::FormatOption::ShowMessage) {
-    ix += vsnprintf(&buffer[ix], len - ix, message, ap);
-    if (ix > len) {
-      ix = len;
+  if (ix > len) {
+    ix = len;
+  }
+  return ix;
+}
+
+int SimpleLog::Impl::logV(SimpleLog::Severity s, const char* message, va_list ap, const SimpleLog::Field* fields, size_t nFields)
+{
+  return logFormatted(s, message, SimpleLogPrintfFormatter(message, ap), fields, nFields);
+}
+
+int SimpleLog::Impl::logFormatted(SimpleLog::Severity s, const char* callSite, const SimpleLogFormatter& formatter, const SimpleLog::Field* fields, size_t nFields)
+{
+  if ((rateLimitInterval.load(std::memory_order_relaxed) != 0) && (!checkRateLimit(callSite))) {
+    return 0;
+  }
+
+  if ((int)s >= recorderLevel.load(std::memory_order_relaxed)) {
+    recordFormatted(s, formatter);
+  }
+
+  // immediate return if output disabled
+  if ((disableOutput) || ((int)s < outputLevel.load(std::memory_order_relaxed))) {
+    return 0;
+  }
+
+  return writeFormatted(s, formatter, true, fields, nFields);
+}
+
+int SimpleLog::Impl::writeFormatted(SimpleLog::Severity s, const SimpleLogFormatter& formatter, bool checkDuplicates, const SimpleLog::Field* fields, size_t nFields)
+{
+  char stackBuffer[1024];
+  SimpleLogFormatBuffer buffer(stackBuffer, sizeof(stackBuffer), simpleLogMessageOverflow);
+  int opts = formatOptions;
+
+  // message is formatted a second time if it does not fit in the stack buffer
+  if (opts & (SimpleLog::FormatOption::OutputJSON | SimpleLog::FormatOption::OutputLogfmt)) {
+    int n = formatter.format(buffer.data, buffer.size);
+    if (n < 0) {
+      n = 0;
+    } else if ((size_t)n >= buffer.size) {
+      buffer.reserve(n + 1);
+      formatter.format(buffer.data, n + 1);
+    }
+    if (checkDuplicates && duplicatesEnabled.load(std::memory_order_relaxed) && checkDuplicate(s, buffer.data, n)) {
+      return 0;
+    }
+    struct timespec ts;
+    getTime(ts, opts & SimpleLog::FormatOption::CoarseTimeStamp);
+    return writeStructured(s, opts, ts, getThreadInfo(ts.tv_sec), buffer.data, n, fields, nFields);
+  }
+
+  size_t ix = formatPrefix(buffer.data, buffer.size, s, opts, NULL);
+  size_t prefixLength = ix;
+
+  if (opts & SimpleLog::FormatOption::ShowMessage) {
+    // keep 2 bytes for end of line and zero
+    int n = formatter.format(&buffer.data[ix], buffer.size - ix - 2);
+    if (n > 0) {
+      if (ix + n + 2 >= buffer.size) {
+        buffer.reserve(ix + n + 3);
+        formatter.format(&buffer.data[ix], n + 1);
+      }
+      ix += n;
+    }
+  }
+
+  if (nFields) {
+    // in text output, key/value pairs are appended to the message (logfmt style)
+    size_t maxSize = 1;
+    for (size_t i = 0; i < nFields; i++) {
+      maxSize += SimpleLogSerializer::getMaxSize(strlen(fields[i].key), strlen(fields[i].value));
     }
+    buffer.reserve(ix + maxSize + 8);
+    buffer.data[ix++] = ' ';
+    SimpleLogSerializer serializer(&buffer.data[ix], buffer.size - ix, false);
+    for (size_t i = 0; i < nFields; i++) {
+      serializer.addField(fields[i].key, fields[i].value);
+    }
+    ix += serializer.end() - 1; // without end of line, added below
+  }
+
+  if (checkDuplicates && duplicatesEnabled.load(std::memory_order_relaxed) && checkDuplicate(s, &buffer.data[prefixLength], ix - prefixLength)) {
+    return 0;
   }
 
-  buffer[ix] = '\n';
+  buffer.data[ix] = '\n';
   ix++;
-  buffer[ix] = 0;
-
-  int fd;
-  if (fp != NULL) {
-    if ((ix + logFileSize > rotateMaxBytes) && (rotateMaxBytes > 0)) {
-      closeLogFile();
-      if (rotateMaxFiles == 1) {
-        // stop after first file
-        disableOutput = 1;
-        return -1;
+  buffer.data[ix] = 0;
+
+  return writeMessage(s, buffer.data, ix, prefixLength);
+}
+
+int SimpleLog::Impl::writeStructured(SimpleLog::Severity s, int opts, const struct timespec& ts, const SimpleLogThreadInfo& thread, const char* message, size_t size, const SimpleLog::Field* fields, size_t nFields)
+{
+  const char* severityName = "info";
+  if (s == Severity::Error) {
+    severityName = "error";
+  } else if (s == Severity::Warning) {
+    severityName = "warning";
+  } else if (s == Severity::Debug) {
+    severityName = "debug";
+  } else if (s == Severity::Trace) {
+    severityName = "trace";
+  }
+
+  // timestamp in ISO 8601 format (local time)
+  char timeStamp[32];
+  size_t timeStampLength = formatTimeStamp(timeStamp, sizeof(timeStamp), ts);
+  if (timeStampLength > 10) {
+    timeStamp[10] = 'T';
+  }
+
+  const SimpleLogFieldList* common = commonFields.load(std::memory_order_acquire);
+
+  char stackBuffer[2048];
+  SimpleLogFormatBuffer buffer(stackBuffer, sizeof(stackBuffer), simpleLogRecordOverflow);
+  for (;;) {
+    SimpleLogSerializer serializer(buffer.data, buffer.size, opts & SimpleLog::FormatOption::OutputJSON);
+    serializer.addField("time", timeStamp, timeStampLength);
+    serializer.addField("severity", severityName);
+    serializer.addField("pid", (long)thread.pid);
+    serializer.addField("tid", (long)thread.tid);
+    serializer.addField("thread", thread.name);
+    serializer.addField("msg", message, size);
+    if (common != nullptr) {
+      for (size_t i = 0; i < common->keys.size(); i++) {
+        serializer.addField(common->keys[i].c_str(), common->values[i].data(), common->values[i].size());
       }
-      rotate();
-      if (openLogFile())
-        return -1;
     }
-    fd = fileno(fp);
+    for (size_t i = 0; i < nFields; i++) {
+      serializer.addField(fields[i].key, fields[i].value);
+    }
+    size_t len = serializer.end();
+    if ((!serializer.isTruncated()) || (buffer.data != stackBuffer)) {
+      return writeMessage(s, buffer.data, len);
+    }
+
+    // record does not fit in stack buffer: serialize again, in a buffer large enough for the worst case
+    size_t maxSize = 512 + SimpleLogSerializer::getMaxSize(0, size);
+    if (common != nullptr) {
+      for (size_t i = 0; i < common->keys.size(); i++) {
+        maxSize += SimpleLogSerializer::getMaxSize(common->keys[i].size(), common->values[i].size());
+      }
+    }
+    for (size_t i = 0; i < nFields; i++) {
+      maxSize += SimpleLogSerializer::getMaxSize(strlen(fields[i].key), strlen(fields[i].value));
+    }
+    buffer.reserve(maxSize);
+  }
+}
+
+void SimpleLog::Impl::recordFormatted(SimpleLog::Severity s, const SimpleLogFormatter& formatter)
+{
+  SimpleLogFlightRecorder* recorder = simpleLogFlightRecorder.load(std::memory_order_acquire);
+  if (recorder == nullptr) {
+    return;
+  }
+  uint64_t index;
+  SimpleLogFlightRecorder::Slot* slot = recorder->reserve(index);
+  size_t len = sizeof(slot->text) - 1; // keep space for end of line
+  size_t ix = formatPrefix(slot->text, len, s, SimpleLog::FormatOption::ShowTimeStamp | SimpleLog::FormatOption::ShowSeveritySymbol, NULL);
+  int n = formatter.format(&slot->text[ix], len - ix);
+  if (n > 0) {
+    ix += n;
+    if (ix > len - 1) {
+      ix = len - 1;
+      getCounters().truncations.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  slot->text[ix++] = '\n';
+  recorder->commit(slot, index, ix);
+}
+
+void SimpleLog::Impl::recordDeferred(const SimpleLogDeferredRecord* record)
+{
+  SimpleLogFlightRecorder* recorder = simpleLogFlightRecorder.load(std::memory_order_acquire);
+  if (recorder == nullptr) {
+    return;
+  }
+  struct timespec ts;
+  ts.tv_sec = record->timeNs / 1000000000;
+  ts.tv_nsec = record->timeNs % 1000000000;
+  uint64_t index;
+  SimpleLogFlightRecorder::Slot* slot = recorder->reserve(index);
+  size_t len = sizeof(slot->text) - 1; // keep space for end of line
+  size_t ix = formatPrefix(slot->text, len, (SimpleLog::Severity)record->severity, SimpleLog::FormatOption::ShowTimeStamp | SimpleLog::FormatOption::ShowSeveritySymbol, &ts);
+  ix += formatDeferredMessage(&slot->text[ix], len - ix, record->format, (const char*)&record[1], ((const char*)record) + record->size);
+  if (ix >= len - 1) {
+    // slot full, message is most probably truncated
+    getCounters().truncations.fetch_add(1, std::memory_order_relaxed);
+  }
+  slot->text[ix++] = '\n';
+  recorder->commit(slot, index, ix);
+}
+
+int SimpleLog::Impl::logInternal(SimpleLog::Severity s, const char* message, ...)
+{
+  int err = 0;
+
+  va_list ap;
+  va_start(ap, message);
+  err = writeFormatted(s, SimpleLogPrintfFormatter(message, ap), false);
+  va_end(ap);
+
+  return err;
+}
+
+// get current time from a monotonic clock, in nanoseconds
+static uint64_t getMonotonicTime()
+{
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool SimpleLog::Impl::checkRateLimit(const char* format)
+{
+  // find entry for this call site, or a free one
+  SimpleLogRateLimitEntry* entry = nullptr;
+  uint64_t h = ((uint64_t)(uintptr_t)format >> 3) * 0x9E3779B97F4A7C15ULL;
+  unsigned int ix = (unsigned int)(h >> 32) % rateLimitTableSize;
+  for (unsigned int i = 0; i < rateLimitMaxProbes; i++) {
+    SimpleLogRateLimitEntry* e = &rateLimitTable[(ix + i) % rateLimitTableSize];
+    const char* f = e->format.load(std::memory_order_acquire);
+    if (f == nullptr) {
+      if (e->format.compare_exchange_strong(f, format)) {
+        entry = e;
+        break;
+      }
+    }
+    if (f == format) {
+      entry = e;
+      break;
+    }
+  }
+  if (entry == nullptr) {
+    // table full, no limit for this call site
+    return true;
+  }
+
+  // token bucket: the message is accepted if the bucket is not empty, i.e. if nextTime is less than burst time ahead
+  uint64_t interval = rateLimitInterval.load(std::memory_order_relaxed);
+  uint64_t burst = rateLimitBurst.load(std::memory_order_relaxed);
+  uint64_t now = getMonotonicTime();
+  uint64_t nextTime = entry->nextTime.load(std::memory_order_relaxed);
+  for (;;) {
+    if (nextTime > now + burst) {
+      entry->nSuppressed.fetch_add(1, std::memory_order_relaxed);
+      getCounters().suppressed.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    uint64_t newNextTime = ((nextTime > now) ? nextTime : now) + interval;
+    if (entry->nextTime.compare_exchange_weak(nextTime, newNextTime, std::memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  // report messages suppressed before this one, if any
+  if (entry->nSuppressed.load(std::memory_order_relaxed) != 0) {
+    unsigned long n = entry->nSuppressed.exchange(0);
+    if (n != 0) {
+      logInternal(Severity::Warning, "%lu messages suppressed (rate limit): %s", n, format);
+    }
+  }
+  return true;
+}
+
+bool SimpleLog::Impl::checkDuplicate(SimpleLog::Severity s, const char* message, size_t size)
+{
+  // FNV-1a hash of message content and severity
+  uint64_t hash = 0xcbf29ce484222325ULL ^ (uint64_t)s;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ (unsigned char)message[i]) * 0x100000001b3ULL;
+  }
+
+  std::unique_lock<std::mutex> lock(lastMessageLock);
+  if (lastMessageHash == hash) {
+    lastMessageRepeat++;
+    lock.unlock();
+    getCounters().suppressed.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  unsigned long n = lastMessageRepeat;
+  int previousSeverity = lastMessageSeverity;
+  lastMessageHash = hash;
+  lastMessageSeverity = (int)s;
+  lastMessageRepeat = 0;
+  lock.unlock();
+  if (n != 0) {
+    logInternal((SimpleLog::Severity)previousSeverity, "last message repeated %lu times", n);
+  }
+  return false;
+}
+
+void SimpleLog::Impl::reportSuppressed()
+{
+  if (rateLimitInterval != 0) {
+    for (unsigned int i = 0; i < rateLimitTableSize; i++) {
+      SimpleLogRateLimitEntry* e = &rateLimitTable[i];
+      const char* format = e->format.load(std::memory_order_acquire);
+      if ((format != nullptr) && (e->nSuppressed.load(std::memory_order_relaxed) != 0)) {
+        unsigned long n = e->nSuppressed.exchange(0);
+        if (n != 0) {
+          logInternal(Severity::Warning, "%lu messages suppressed (rate limit): %s", n, format);
+        }
+      }
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock(lastMessageLock);
+    unsigned long n = lastMessageRepeat;
+    int severity = lastMessageSeverity;
+    lastMessageRepeat = 0;
+    lock.unlock();
+    if (n != 0) {
+      logInternal((SimpleLog::Severity)severity, "last message repeated %lu times", n);
+    }
+  }
+  if (socketDropped != 0) {
+    unsigned long n = socketDropped.exchange(0);
+    if (n != 0) {
+      logInternal(Severity::Warning, "%lu messages dropped (socket output unavailable)", n);
+    }
+  }
+}
+
+int SimpleLog::Impl::writeMessage(SimpleLog::Severity s, const char* buffer, size_t size, size_t prefixLength)
+{
+  int err = writeOutput(s, buffer, size, prefixLength);
+  if (err > 0) {
+    // output disabled, nothing written
+    return 0;
+  }
+  SimpleLogCounters& c = getCounters();
+  if (err < 0) {
+    c.writeFailures.fetch_add(1, std::memory_order_relaxed);
+    return -1;
+  }
+  if (((int)s >= 0) && ((int)s < SimpleLog::Stats::nSeverities)) {
+    c.messages[s].fetch_add(1, std::memory_order_relaxed);
+    c.bytes[s].fetch_add(size, std::memory_order_relaxed);
+  }
+  return 0;
+}
+
+int SimpleLog::Impl::writeOutput(SimpleLog::Severity s, const char* buffer, size_t size, size_t prefixLength)
+{
+  for (;;) {
+    std::shared_lock<std::shared_mutex> lock(fileLock);
+    if (disableOutput) {
+      return 1;
+    }
+
+    if (socketFd >= 0) {
+      return sendSocket(s, &buffer[prefixLength], size - prefixLength);
+    }
+
+    int fdOut;
+    if (fd >= 0) {
+      // check if rotation period elapsed, otherwise reserve space in current file and check if it is full
+      bool isRotationDue = (rotatePeriod > 0) && (time(NULL) >= rotateTime.load(std::memory_order_relaxed));
+      size_t offset = 0;
+      if (!isRotationDue) {
+        offset = logFileSize.fetch_add(size);
+        if ((rotateMaxBytes > 0) && (offset + size > rotateMaxBytes) && (offset > 0)) {
+          // file full: keep track of the end of its content
+          size_t previousOffset = rotateOffset;
+          while ((offset < previousOffset) && (!rotateOffset.compare_exchange_weak(previousOffset, offset))) {
+          }
+          isRotationDue = true;
+        }
+      }
+      if (isRotationDue) {
+        // switch to exclusive mode to rotate,
+        // unless another thread did it in the meantime, then retry
+        unsigned long previousRotateCount = rotateCount;
+        lock.unlock();
+        std::unique_lock<std::shared_mutex> rotateLock(fileLock);
+        if ((rotateCount == previousRotateCount) && (fd >= 0)) {
+          if (rotateLogFile()) {
+            return -1;
+          }
+        }
+        continue;
+      }
+      if (mapBase != nullptr) {
+        return writeMapped(buffer, size, offset);
+      }
+      fdOut = fd;
+    } else {
+      if (s == Severity::Error) {
+        fdOut = fdStderr;
+      } else {
+        fdOut = fdStdout;
+      }
+    }
+
+    if (outputBuffer.size() > 0) {
+      return writeBuffered(s, fdOut, buffer, size);
+    }
+
+    ssize_t nBytes = write(fdOut, buffer, size);
+    if (nBytes != (ssize_t)size) {
+      releaseFileSpace(fdOut, size, nBytes);
+      return -1;
+    }
+    return 0;
+  }
+}
+
+int SimpleLog::Impl::decodeDeferredArg(const char*& p, const char* end, SimpleLogDeferredArg& arg)
+{
+  if (p >= end) {
+    return -1;
+  }
+  arg.type = *(p++);
+  arg.size = sizeof(uint64_t);
+  if ((arg.type == SimpleLog::DeferredArgInt) || (arg.type == SimpleLog::DeferredArgUInt)) {
+    arg.size = *(p++);
+    memcpy(&arg.value, p, sizeof(arg.value));
+    p += sizeof(arg.value);
+  } else if (arg.type == SimpleLog::DeferredArgDouble) {
+    memcpy(&arg.valueDouble, p, sizeof(arg.valueDouble));
+    p += sizeof(arg.valueDouble);
+  } else if (arg.type == SimpleLog::DeferredArgPointer) {
+    memcpy(&arg.value, p, sizeof(arg.value));
+    p += sizeof(arg.value);
   } else {
-    if (s == Severity::Error) {
-      fd = fdStderr;
+    memcpy(&arg.len, p, sizeof(arg.len));
+    p += sizeof(arg.len);
+    arg.str = p;
+    p += arg.len;
+  }
+  return 0;
+}
+
+size_t SimpleLog::Impl::formatDeferredMessage(char* buffer, size_t size, const char* format, const char* args, const char* argsEnd)
+{
+  size_t ix = 0;
+  const char* p = format;
+
+  // update current position in buffer after a snprintf() call
+  auto advance = [&](int n) {
+    if (n > 0) {
+      ix += n;
+    }
+    if (ix >= size) {
+      ix = size - 1;
+    }
+  };
+
+  while ((*p != 0) && (ix + 1 < size)) {
+    if (*p != '%') {
+      // copy plain text up to next conversion specification
+      const char* nextSpec = strchr(p, '%');
+      size_t n = (nextSpec == NULL) ? strlen(p) : (size_t)(nextSpec - p);
+      if (n > size - 1 - ix) {
+        n = size - 1 - ix;
+      }
+      memcpy(&buffer[ix], p, n);
+      ix += n;
+      p += n;
+      continue;
+    }
+    if (p[1] == '%') {
+      buffer[ix++] = '%';
+      p += 2;
+      continue;
+    }
+
+    // parse conversion specification, and rebuild it to match the type of recorded arguments
+    const char* specBegin = p++;
+    char spec[64];
+    size_t specLen = 0;
+    int precision = -1;
+    bool isValid = true;
+    SimpleLogDeferredArg arg;
+    spec[specLen++] = '%';
+    while ((*p != 0) && (strchr("-+ #0'", *p) != NULL) && (specLen < 16)) {
+      spec[specLen++] = *(p++);
+    }
+    if (*p == '*') {
+      p++;
+      if (decodeDeferredArg(args, argsEnd, arg) == 0) {
+        specLen += snprintf(&spec[specLen], 16, "%d", (int)arg.value);
+      } else {
+        isValid = false;
+      }
+    } else {
+      for (int i = 0; isdigit(*p) && (i < 8); i++) {
+        spec[specLen++] = *(p++);
+      }
+    }
+    if (*p == '.') {
+      p++;
+      if (*p == '*') {
+        p++;
+        if (decodeDeferredArg(args, argsEnd, arg) == 0) {
+          precision = (int)arg.value;
+        } else {
+          isValid = false;
+        }
+      } else {
+        precision = 0;
+        for (int i = 0; isdigit(*p) && (i < 8); i++) {
+          precision = precision * 10 + (*(p++) - '0');
+        }
+      }
+    }
+    while ((*p != 0) && (strchr("hlLqjzt", *p) != NULL)) {
+      // length modifiers are replaced by the ones matching recorded arguments
+      p++;
+    }
+    char conversion = *p;
+    if (conversion == 0) {
+      isValid = false;
+    } else {
+      p++;
+    }
+    if ((conversion == 'n') || (conversion == 'm')) {
+      // %n not supported (its argument is skipped), %m ignored
+      if (conversion == 'n') {
+        decodeDeferredArg(args, argsEnd, arg);
+      }
+      continue;
+    }
+    if ((!isValid) || (strchr("diouxXcseEfFgGaAp", conversion) == NULL) || (decodeDeferredArg(args, argsEnd, arg) != 0)) {
+      // not a valid conversion, or missing argument: copy specification as is
+      advance(snprintf(&buffer[ix], size - ix, "%.*s", (int)(p - specBegin), specBegin));
+      continue;
+    }
+
+    // if conversion does not match argument type, use a default one for this type
+    bool isFloatConversion = (strchr("eEfFgGaA", conversion) != NULL);
+    if ((arg.type == SimpleLog::DeferredArgString) != (conversion == 's')) {
+      switch (arg.type) {
+        case SimpleLog::DeferredArgInt:
+          conversion = 'd';
+          break;
+        case SimpleLog::DeferredArgUInt:
+          conversion = 'u';
+          break;
+        case SimpleLog::DeferredArgDouble:
+          conversion = 'g';
+          break;
+        case SimpleLog::DeferredArgPointer:
+          conversion = 'p';
+          break;
+        default:
+          conversion = 's';
+      }
+    } else if ((arg.type == SimpleLog::DeferredArgDouble) && (!isFloatConversion)) {
+      // floating point value with integer conversion
+      arg.type = SimpleLog::DeferredArgInt;
+      arg.value = (uint64_t)(int64_t)arg.valueDouble;
+    } else if ((arg.type != SimpleLog::DeferredArgDouble) && (isFloatConversion)) {
+      // integer value with floating point conversion
+      arg.valueDouble = (arg.type == SimpleLog::DeferredArgInt) ? (double)(int64_t)arg.value : (double)arg.value;
+    }
+
+    if (conversion == 's') {
+      int len = (int)arg.len;
+      if ((precision >= 0) && (precision < len)) {
+        len = precision;
+      }
+      specLen += snprintf(&spec[specLen], sizeof(spec) - specLen, ".*s");
+      advance(snprintf(&buffer[ix], size - ix, spec, len, arg.str));
+      continue;
+    }
+    if (precision >= 0) {
+      specLen += snprintf(&spec[specLen], sizeof(spec) - specLen, ".%d", precision);
+    }
+    if (strchr("di", conversion) != NULL) {
+      snprintf(&spec[specLen], sizeof(spec) - specLen, "lld");
+      advance(snprintf(&buffer[ix], size - ix, spec, (long long)arg.value));
+    } else if (strchr("ouxX", conversion) != NULL) {
+      if ((arg.type == SimpleLog::DeferredArgInt) && (arg.size < (int)sizeof(uint64_t))) {
+        // keep only bits of original type for negative values
+        arg.value &= (((uint64_t)1) << (8 * arg.size)) - 1;
+      }
+      snprintf(&spec[specLen], sizeof(spec) - specLen, "ll%c", conversion);
+      advance(snprintf(&buffer[ix], size - ix, spec, (unsigned long long)arg.value));
+    } else if (conversion == 'c') {
+      snprintf(&spec[specLen], sizeof(spec) - specLen, "c");
+      advance(snprintf(&buffer[ix], size - ix, spec, (int)arg.value));
+    } else if (conversion == 'p') {
+      snprintf(&spec[specLen], sizeof(spec) - specLen, "p");
+      advance(snprintf(&buffer[ix], size - ix, spec, (void*)(uintptr_t)arg.value));
     } else {
-      fd = fdStdout;
+      snprintf(&spec[specLen], sizeof(spec) - specLen, "%c", conversion);
+      advance(snprintf(&buffer[ix], size - ix, spec, arg.valueDouble));
+    }
+  }
+  return ix;
+}
+
+SimpleLogDeferredBuffer* SimpleLog::Impl::getDeferredBuffer()
+{
+  SimpleLogDeferredThreadCache& cache = simpleLogDeferredThreadCache;
+  if ((cache.instanceId == instanceId) && (cache.buffer != nullptr)) {
+    return cache.buffer.get();
+  }
+
+  // this thread used another SimpleLog instance before, release its buffer
+  if (cache.buffer != nullptr) {
+    cache.buffer->writerExited = true;
+  }
+
+  std::unique_lock<std::mutex> lock(deferredLock);
+  auto& buffer = deferredBuffers[std::this_thread::get_id()];
+  if (buffer == nullptr) {
+    buffer = std::make_shared<SimpleLogDeferredBuffer>(deferredBufferSize);
+    deferredBuffersVersion++;
+  }
+  buffer->writerExited = false;
+  buffer->threadInfo = getThreadInfo(time(NULL));
+  cache.instanceId = instanceId;
+  cache.buffer = buffer;
+  startBackend();
+  return buffer.get();
+}
+
+int SimpleLog::deferredReserve(Severity severity, const char* format, size_t argsSize, char*& p)
+{
+  p = nullptr;
+  if (((pImpl->disableOutput) || ((int)severity < pImpl->outputLevel.load(std::memory_order_relaxed))) && ((int)severity < pImpl->recorderLevel.load(std::memory_order_relaxed))) {
+    return 0;
+  }
+  if ((pImpl->rateLimitInterval.load(std::memory_order_relaxed) != 0) && (!pImpl->checkRateLimit(format))) {
+    return 0;
+  }
+
+  SimpleLogDeferredBuffer* buffer = pImpl->getDeferredBuffer();
+  size_t recordSize = (sizeof(SimpleLogDeferredRecord) + argsSize + 7) & ~((size_t)7);
+  SimpleLogDeferredRecord* record = nullptr;
+  if (recordSize <= buffer->data.size() / 2) {
+    record = (SimpleLogDeferredRecord*)buffer->reserve(recordSize, simpleLogDeferredThreadCache.pendingHead);
+  }
+  if (record == nullptr) {
+    pImpl->deferredDropped++;
+    pImpl->backendWakeUp.notify_one();
+    return -1;
+  }
+
+  struct timespec ts;
+  getTime(ts, pImpl->formatOptions & SimpleLog::FormatOption::CoarseTimeStamp);
+  record->size = (uint32_t)recordSize;
+  record->severity = (uint32_t)severity;
+  record->format = format;
+  record->timeNs = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  p = (char*)&record[1];
+  return 0;
+}
+
+void SimpleLog::deferredCommit()
+{
+  SimpleLogDeferredBuffer* buffer = simpleLogDeferredThreadCache.buffer.get();
+  buffer->commit(simpleLogDeferredThreadCache.pendingHead);
+  // wake up backend early when buffer is getting full
+  if (buffer->getUsedSize() > buffer->data.size() / 2) {
+    pImpl->backendWakeUp.notify_one();
+  }
+}
+
+void SimpleLog::Impl::writeDeferred(SimpleLogDeferredRecord* record, const SimpleLogDeferredBuffer* source)
+{
+  char stackBuffer[1024];
+  SimpleLogFormatBuffer buffer(stackBuffer, sizeof(stackBuffer), simpleLogMessageOverflow);
+  int opts = formatOptions;
+  SimpleLog::Severity s = (SimpleLog::Severity)record->severity;
+
+  if ((int)s >= recorderLevel.load(std::memory_order_relaxed)) {
+    recordDeferred(record);
+  }
+  if ((int)s < outputLevel.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  struct timespec ts;
+  ts.tv_sec = record->timeNs / 1000000000;
+  ts.tv_nsec = record->timeNs % 1000000000;
+
+  if (opts & (SimpleLog::FormatOption::OutputJSON | SimpleLog::FormatOption::OutputLogfmt)) {
+    size_t n = formatDeferredRecord(record, buffer, 0);
+    if (duplicatesEnabled.load(std::memory_order_relaxed) && checkDuplicate(s, buffer.data, n)) {
+      return;
     }
+    writeStructured(s, opts, ts, source->threadInfo, buffer.data, n, nullptr, 0);
+    return;
+  }
+
+  size_t ix = formatPrefix(buffer.data, buffer.size, s, opts, &ts);
+  size_t prefixLength = ix;
+
+  if (opts & SimpleLog::FormatOption::ShowMessage) {
+    ix += formatDeferredRecord(record, buffer, ix);
+  }
+
+  if (duplicatesEnabled.load(std::memory_order_relaxed) && checkDuplicate(s, &buffer.data[prefixLength], ix - prefixLength)) {
+    return;
+  }
+
+  buffer.data[ix] = '\n';
+  ix++;
+  buffer.data[ix] = 0;
+
+  writeMessage(s, buffer.data, ix, prefixLength);
+}
+
+size_t SimpleLog::Impl::formatDeferredRecord(const SimpleLogDeferredRecord* record, SimpleLogFormatBuffer& buffer, size_t offset)
+{
+  const char* args = (const char*)&record[1];
+  const char* argsEnd = ((const char*)record) + record->size;
+  for (;;) {
+    // keep 2 bytes for end of line and zero
+    size_t n = formatDeferredMessage(&buffer.data[offset], buffer.size - offset - 1, record->format, args, argsEnd);
+    if (offset + n + 2 < buffer.size) {
+      return n;
+    }
+    // output may be truncated: try again with a larger buffer
+    buffer.reserve(2 * buffer.size);
+  }
+}
+
+int SimpleLog::Impl::processDeferred()
+{
+  // update local copy of list of buffers when it changes
+  std::vector<std::shared_ptr<SimpleLogDeferredBuffer>>& buffers = backendBuffers;
+  {
+    std::unique_lock<std::mutex> lock(deferredLock);
+    // release buffers not used anymore
+    for (auto it = deferredBuffers.begin(); it != deferredBuffers.end();) {
+      if ((it->second->writerExited) && (it->second->getUsedSize() == 0)) {
+        it = deferredBuffers.erase(it);
+        deferredBuffersVersion++;
+      } else {
+        ++it;
+      }
+    }
+    if (backendBuffersVersion != deferredBuffersVersion) {
+      buffers.clear();
+      for (const auto& b : deferredBuffers) {
+        buffers.push_back(b.second);
+      }
+      backendBuffersVersion = deferredBuffersVersion;
+    }
+  }
+
+  // messages are merged from all buffers, in time order
+  // only messages available at start of this function are processed
+  std::vector<uint64_t> heads;
+  for (const auto& b : buffers) {
+    heads.push_back(b->head.load(std::memory_order_acquire));
+  }
+  int nProcessed = 0;
+  for (;;) {
+    SimpleLogDeferredRecord* next = nullptr;
+    SimpleLogDeferredBuffer* nextBuffer = nullptr;
+    for (unsigned int i = 0; i < buffers.size(); i++) {
+      SimpleLogDeferredBuffer* b = buffers[i].get();
+      uint64_t t = b->tail.load(std::memory_order_relaxed);
+      while (t != heads[i]) {
+        SimpleLogDeferredRecord* r = (SimpleLogDeferredRecord*)&b->data[t % b->data.size()];
+        if (r->severity == SimpleLogDeferredRecord::paddingMark) {
+          t += r->size;
+          b->tail.store(t, std::memory_order_release);
+          continue;
+        }
+        if ((next == nullptr) || (r->timeNs < next->timeNs)) {
+          next = r;
+          nextBuffer = b;
+        }
+        break;
+      }
+    }
+    if (next == nullptr) {
+      break;
+    }
+    writeDeferred(next, nextBuffer);
+    nextBuffer->tail.store(nextBuffer->tail.load(std::memory_order_relaxed) + next->size, std::memory_order_release);
+    nProcessed++;
+  }
+  return nProcessed;
+}
+
+void SimpleLog::Impl::backendLoop()
+{
+  unsigned long nDroppedReported = 0;
+  std::chrono::steady_clock::time_point lastSuppressedReport = std::chrono::steady_clock::now();
+  for (;;) {
+    bool isShutdown;
+    unsigned long flushRequest;
+    {
+      std::unique_lock<std::mutex> lock(backendMutex);
+      isShutdown = backendShutdown;
+      flushRequest = backendFlushRequest;
+    }
+
+    int nProcessed = processDeferred();
+
+    // report dropped messages, if any
+    unsigned long nDropped = deferredDropped;
+    if (nDropped != nDroppedReported) {
+      logInternal(Severity::Warning, "%lu deferred messages dropped (buffer full)", nDropped - nDroppedReported);
+      nDroppedReported = nDropped;
+    }
+
+    // report suppressed messages periodically
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastSuppressedReport >= std::chrono::seconds(1)) {
+      reportSuppressed();
+      lastSuppressedReport = now;
+    }
+
+    // write output buffer on timeout, or when requested
+    if (flushRequest != backendFlushDone) {
+      reportSuppressed();
+      checkOutputBuffer(true);
+      std::unique_lock<std::mutex> lock(backendMutex);
+      backendFlushDone = flushRequest;
+      backendFlushed.notify_all();
+    } else {
+      checkOutputBuffer(false);
+    }
+
+    if (nProcessed == 0) {
+      if (isShutdown) {
+        break;
+      }
+      std::unique_lock<std::mutex> lock(backendMutex);
+      if ((!backendShutdown) && (backendFlushRequest == backendFlushDone)) {
+        backendWakeUp.wait_for(lock, std::chrono::milliseconds(backendIdleSleepTime));
+      }
+    }
+  }
+
+  reportSuppressed();
+  checkOutputBuffer(true);
+
+  // release pending flush requests
+  std::unique_lock<std::mutex> lock(backendMutex);
+  backendFlushDone = backendFlushRequest;
+  backendFlushed.notify_all();
+}
+
+void SimpleLog::Impl::startBackend()
+{
+  std::unique_lock<std::mutex> lock(backendMutex);
+  if (!backendThread.joinable()) {
+    backendShutdown = false;
+    backendThread = std::thread(&SimpleLog::Impl::backendLoop, this);
+  }
+}
+
+void SimpleLog::Impl::stopBackend()
+{
+  {
+    std::unique_lock<std::mutex> lock(backendMutex);
+    if (!backendThread.joinable()) {
+      return;
+    }
+    backendShutdown = true;
+  }
+  backendWakeUp.notify_one();
+  backendThread.join();
+}
+
+void SimpleLog::Impl::flushBackend()
+{
+  std::unique_lock<std::mutex> lock(backendMutex);
+  if (!backendThread.joinable()) {
+    return;
+  }
+  unsigned long request = ++backendFlushRequest;
+  backendWakeUp.notify_one();
+  backendFlushed.wait(lock, [&] { return backendFlushDone >= request; });
+}
+
+int SimpleLog::Impl::sendSocket(SimpleLog::Severity s, const char* message, size_t size)
+{
+  // end of line not needed in a datagram
+  if ((size > 0) && (message[size - 1] == '\n')) {
+    size--;
+  }
+
+  // syslog severity codes (see syslog.h)
+  int severityCode = 6;
+  if (s == Severity::Error) {
+    severityCode = 3;
+  } else if (s == Severity::Warning) {
+    severityCode = 4;
+  } else if ((s == Severity::Debug) || (s == Severity::Trace)) {
+    severityCode = 7;
+  }
+
+  // header as expected by syslog daemons and journald on a local socket (RFC 3164): "<priority>Mmm dd hh:mm:ss tag: "
+  thread_local time_t cachedSecond = (time_t)-1; // time for which the date string below was created
+  thread_local char cachedDate[16];              // "Mmm dd hh:mm:ss"
+  time_t now = time(NULL);
+  if (now != cachedSecond) {
+    struct tm tm_str;
+    localtime_r(&now, &tm_str);
+    strftime(cachedDate, sizeof(cachedDate), "%b %e %T", &tm_str);
+    cachedSecond = now;
+  }
+  char header[32];
+  int headerLength = snprintf(header, sizeof(header), "<%d>%s ", socketFacility | severityCode, cachedDate);
+
+  // the message is sent with a single non-blocking call, without copy
+  struct iovec iov[3];
+  iov[0].iov_base = header;
+  iov[0].iov_len = headerLength;
+  iov[1].iov_base = (void*)socketTag.data();
+  iov[1].iov_len = socketTag.size();
+  iov[2].iov_base = (void*)message;
+  iov[2].iov_len = size;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &socketAddress;
+  msg.msg_namelen = sizeof(socketAddress);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 3;
+  if (sendmsg(socketFd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+    // service not running, or not keeping up
+    socketDropped++;
+    return -1;
+  }
+  return 0;
+}
+
+int SimpleLog::Impl::writeBuffered(SimpleLog::Severity s, int fdOut, const char* buffer, size_t size)
+{
+  int err = 0;
+  std::unique_lock<std::mutex> lock(outputBufferLock);
+  if ((outputBufferUsed > 0) && (fdOut != outputBufferFd)) {
+    // buffer contains data for another output
+    err = flushOutputBuffer();
+  }
+  outputBufferFd = fdOut;
+
+  if (outputBufferUsed + size <= outputBuffer.size()) {
+    if (outputBufferUsed == 0) {
+      outputBufferTime = std::chrono::steady_clock::now();
+    }
+    memcpy(&outputBuffer[outputBufferUsed], buffer, size);
+    outputBufferUsed += size;
+    // errors are written immediately
+    if (s == Severity::Error) {
+      err |= flushOutputBuffer();
+    }
+  } else {
+    // buffer full: write its content and the new message with a single call
+    struct iovec iov[2];
+    iov[0].iov_base = &outputBuffer[0];
+    iov[0].iov_len = outputBufferUsed;
+    iov[1].iov_base = (void*)buffer;
+    iov[1].iov_len = size;
+    ssize_t nBytes = writev(fdOut, iov, 2);
+    if (nBytes != (ssize_t)(outputBufferUsed + size)) {
+      releaseFileSpace(fdOut, outputBufferUsed + size, nBytes);
+      err = -1;
+    }
+    outputBufferUsed = 0;
+  }
+  return err;
+}
+
+int SimpleLog::Impl::flushOutputBuffer()
+{
+  if (outputBufferUsed == 0) {
+    return 0;
+  }
+  ssize_t nBytes = write(outputBufferFd, &outputBuffer[0], outputBufferUsed);
+  int err = 0;
+  if (nBytes != (ssize_t)outputBufferUsed) {
+    releaseFileSpace(outputBufferFd, outputBufferUsed, nBytes);
+    err = -1;
+  }
+  outputBufferUsed = 0;
+  return err;
+}
+
+void SimpleLog::Impl::releaseFileSpace(int fdOut, size_t size, ssize_t nBytes)
+{
+  if ((fd < 0) || (fdOut != fd)) {
+    return;
+  }
+  size_t written = (nBytes > 0) ? (size_t)nBytes : 0;
+  if (written < size) {
+    logFileSize.fetch_sub(size - written);
+  }
+}
+
+void SimpleLog::Impl::checkOutputBuffer(bool force)
+{
+  std::shared_lock<std::shared_mutex> lock(fileLock);
+  std::unique_lock<std::mutex> bufferLock(outputBufferLock);
+  if (outputBufferUsed == 0) {
+    return;
+  }
+  if (force || (std::chrono::steady_clock::now() - outputBufferTime >= outputBufferFlushTimeout)) {
+    // no caller to report the error to
+    if (flushOutputBuffer()) {
+      getCounters().writeFailures.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+SimpleLog::SimpleLog(const char* logFilePath)
+{
+  logLevel = (int)Severity::Info;
+  pImpl = std::make_unique<SimpleLog::Impl>();
+  if (pImpl == NULL) {
+    throw __LINE__;
+  }
+  setLogFile(logFilePath);
+}
+
+SimpleLog::~SimpleLog()
+{
+  // write pending deferred messages before closing file
+  pImpl->stopBackend();
+  setLogFile(NULL);
+  pImpl->stopRotation();
+}
+
+int SimpleLog::setLogFile(const char* logFilePath, unsigned long rotateMaxBytes, unsigned int rotateMaxFiles, unsigned int rotateNow)
+{
+  // previous rotations may still have to move files to their final place
+  std::unique_lock<std::shared_mutex> lock(pImpl->fileLock, std::defer_lock);
+  pImpl->lockFileIdle(lock);
+  pImpl->closeLogFile();
+  pImpl->releaseNextFile();
+  pImpl->logFilePath = "";
+  pImpl->rotateMaxFiles = 0;
+  pImpl->rotateMaxBytes = 0;
+  pImpl->logFileSize = 0;
+  pImpl->disableOutput = 0;
+  if (logFilePath != NULL) {
+    pImpl->logFilePath = logFilePath;
+    if (!strcmp(logFilePath, "/dev/null")) {
+      pImpl->disableOutput = 1;
+      return 0;
+    }
+    pImpl->rotateMaxBytes = rotateMaxBytes;
+    pImpl->rotateMaxFiles = rotateMaxFiles;
+    pImpl->recoverRotatedFiles();
+    if (rotateNow) {
+      pImpl->rotate();
+    }
+    if (pImpl->openLogFile()) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int SimpleLog::info(const char* message, ...)
+{
+  int err = 0;
+  if (!isEnabled(Severity::Info)) {
+    return 0;
+  }
+
+  va_list ap;
+  va_start(ap, message);
+  err = pImpl->logV(Severity::Info, message, ap);
+  va_end(ap);
+
+  return err;
+}
+
+int SimpleLog::error(const char* message, ...)
+{
+  int err = 0;
+  if (!isEnabled(Severity::Error)) {
+    return 0;
+  }
+
+  va_list ap;
+  va_start(ap, message);
+  err = pImpl->logV(Severity::Error, message, ap);
+  va_end(ap);
+
+  return err;
+}
+
+int SimpleLog::warning(const char* message, ...)
+{
+  int err = 0;
+  if (!isEnabled(Severity::Warning)) {
+    return 0;
+  }
+
+  va_list ap;
+  va_start(ap, message);
+  err = pImpl->logV(Severity::Warning, message, ap);
+  va_end(ap);
+
+  return err;
+}
+
+int SimpleLog::debug(const char* message, ...)
+{
+  int err = 0;
+  if (!isEnabled(Severity::Debug)) {
+    return 0;
+  }
+
+  va_list ap;
+  va_start(ap, message);
+  err = pImpl->logV(Severity::Debug, message, ap);
+  va_end(ap);
+
+  return err;
+}
+
+int SimpleLog::trace(const char* message, ...)
+{
+  int err = 0;
+  if (!isEnabled(Severity::Trace)) {
+    return 0;
+  }
+
+  va_list ap;
+  va_start(ap, message);
+  err = pImpl->logV(Severity::Trace, message, ap);
+  va_end(ap);
+
+  return err;
+}
+
+int SimpleLog::log(Severity severity, const char* message, ...)
+{
+  int err = 0;
+  if (!isEnabled(severity)) {
+    return 0;
+  }
+
+  va_list ap;
+  va_start(ap, message);
+  err = pImpl->logV(severity, message, ap);
+  va_end(ap);
+
+  return err;
+}
+
+int SimpleLog::log(Severity severity, std::initializer_list<Field> fields, const char* message, ...)
+{
+  int err = 0;
+  if (!isEnabled(severity)) {
+    return 0;
+  }
+
+  va_list ap;
+  va_start(ap, message);
+  err = pImpl->logV(severity, message, ap, fields.begin(), fields.size());
+  va_end(ap);
+
+  return err;
+}
+
+void SimpleLog::setCommonFields(std::initializer_list<Field> fields)
+{
+  auto list = std::make_unique<SimpleLogFieldList>();
+  for (const auto& f : fields) {
+    list->keys.push_back(f.key);
+    list->values.push_back((f.value != nullptr) ? f.value : "");
+  }
+  std::unique_lock<std::mutex> lock(pImpl->commonFieldsLock);
+  pImpl->commonFields.store(list.get(), std::memory_order_release);
+  pImpl->commonFieldsHistory.push_back(std::move(list));
+}
+
+void SimpleLog::setLogLevel(Severity minSeverity)
+{
+  pImpl->outputLevel = (int)minSeverity;
+  logLevel = std::min(pImpl->outputLevel.load(), pImpl->recorderLevel.load());
+}
+
+int SimpleLog::enableFlightRecorder(const char* dumpFilePath, Severity minSeverity, unsigned int nMessages, int dumpSignal)
+{
+  if ((dumpFilePath == NULL) || (strlen(dumpFilePath) >= sizeof(simpleLogFlightRecorderPath)) || (dumpSignal < 0) || (dumpSignal >= NSIG)) {
+    return -1;
+  }
+  {
+    std::unique_lock<std::mutex> lock(simpleLogFlightRecorderLock);
+    if (simpleLogFlightRecorder == nullptr) {
+      if (nMessages == 0) {
+        return -1;
+      }
+      simpleLogFlightRecorder = new SimpleLogFlightRecorder(nMessages);
+      // backtrace() may allocate memory on first call, not safe in a signal handler
+      void* stack[1];
+      backtrace(stack, 1);
+      for (int sig : { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT }) {
+        simpleLogSetSignalHandler(sig, true);
+      }
+    }
+    strcpy(simpleLogFlightRecorderPath, dumpFilePath);
+    if ((dumpSignal != 0) && (dumpSignal != simpleLogFlightRecorderSignal)) {
+      simpleLogFlightRecorderSignal = dumpSignal;
+      simpleLogSetSignalHandler(dumpSignal, false);
+    }
+  }
+  pImpl->recorderLevel = (int)minSeverity;
+  logLevel = std::min(pImpl->outputLevel.load(), pImpl->recorderLevel.load());
+  return 0;
+}
+
+void SimpleLog::disableFlightRecorder()
+{
+  pImpl->recorderLevel = INT_MAX;
+  logLevel = pImpl->outputLevel.load();
+}
+
+int SimpleLog::dumpFlightRecorder(int fd)
+{
+  SimpleLogFlightRecorder* recorder = simpleLogFlightRecorder.load(std::memory_order_acquire);
+  if (recorder == nullptr) {
+    return -1;
+  }
+  return recorder->dump(fd);
+}
+
+void SimpleLog::setOutputFormat(int opts)
+{
+  pImpl->formatOptions = opts;
+}
+
+void SimpleLog::setFileDescriptors(int fdStdout, int fdStderr)
+{
+  std::unique_lock<std::shared_mutex> lock(pImpl->fileLock);
+  pImpl->flushOutputBuffer();
+  pImpl->fdStdout = fdStdout;
+  pImpl->fdStderr = fdStderr;
+}
+
+void SimpleLog::setOutputBuffer(unsigned int bufferSize, unsigned int flushTimeout)
+{
+  {
+    std::unique_lock<std::shared_mutex> lock(pImpl->fileLock);
+    pImpl->flushOutputBuffer();
+    pImpl->outputBuffer.resize(bufferSize);
+    pImpl->outputBuffer.shrink_to_fit();
+    pImpl->outputBufferFlushTimeout = std::chrono::milliseconds(flushTimeout);
+  }
+  if (bufferSize > 0) {
+    // background thread needed to flush buffer on timeout
+    pImpl->startBackend();
+  }
+}
+
+int SimpleLog::logPieces(Severity severity, const char* format, const std::string_view* pieces, size_t nPieces)
+{
+  return pImpl->logFormatted(severity, format, SimpleLogPiecesFormatter(pieces, nPieces));
+}
+
+int SimpleLog::setSocketOutput(const char* socketPath, const char* identifier, int facility)
+{
+  {
+    std::unique_lock<std::shared_mutex> lock(pImpl->fileLock);
+    pImpl->flushOutputBuffer();
+    if (pImpl->socketFd >= 0) {
+      close(pImpl->socketFd);
+      pImpl->socketFd = -1;
+    }
+    if (socketPath == NULL) {
+      return 0;
+    }
+    if (strlen(socketPath) >= sizeof(pImpl->socketAddress.sun_path)) {
+      return -1;
+    }
+    memset(&pImpl->socketAddress, 0, sizeof(pImpl->socketAddress));
+    pImpl->socketAddress.sun_family = AF_UNIX;
+    strcpy(pImpl->socketAddress.sun_path, socketPath);
+    if (identifier == NULL) {
+      identifier = program_invocation_short_name;
+    }
+    pImpl->socketTag = std::string(identifier) + "[" + std::to_string(getpid()) + "]: ";
+    pImpl->socketFacility = facility;
+    // the socket is not connected, so that the service can be restarted
+    pImpl->socketFd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (pImpl->socketFd < 0) {
+      return -1;
+    }
+  }
+  // background thread needed to report dropped messages
+  pImpl->startBackend();
+  return 0;
+}
+
+int SimpleLog::setOutputMapped(size_t mapStep)
+{
+  std::unique_lock<std::shared_mutex> lock(pImpl->fileLock, std::defer_lock);
+  pImpl->lockFileIdle(lock);
+  size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+  pImpl->mapStep = ((mapStep + pageSize - 1) / pageSize) * pageSize;
+  if (pImpl->fd >= 0) {
+    // reopen current file with new settings
+    pImpl->closeLogFile();
+    if (pImpl->openLogFile(true)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void SimpleLog::setRateLimit(unsigned int maxRate, unsigned int burst)
+{
+  if (maxRate == 0) {
+    pImpl->rateLimitInterval = 0;
+    return;
+  }
+  uint64_t interval = 1000000000ULL / maxRate;
+  pImpl->rateLimitBurst = interval * burst;
+  pImpl->rateLimitInterval = (interval > 0) ? interval : 1;
+  // background thread needed to report suppressed messages
+  pImpl->startBackend();
+}
+
+void SimpleLog::setDuplicatesSuppression(bool enabled)
+{
+  {
+    std::unique_lock<std::mutex> lock(pImpl->lastMessageLock);
+    pImpl->lastMessageHash = 0;
+  }
+  pImpl->duplicatesEnabled = enabled;
+  if (enabled) {
+    // background thread needed to report suppressed messages
+    pImpl->startBackend();
+  }
+}
+
+void SimpleLog::flush()
+{
+  pImpl->flushBackend();
+  pImpl->checkOutputBuffer(true);
+}
+
+SimpleLog::Stats SimpleLog::getStats() const
+{
+  Stats stats;
+  memset(&stats, 0, sizeof(stats));
+  for (unsigned int i = 0; i < Impl::nCounters; i++) {
+    const SimpleLogCounters& c = pImpl->counters[i];
+    for (int j = 0; j < Stats::nSeverities; j++) {
+      stats.messages[j] += c.messages[j].load(std::memory_order_relaxed);
+      stats.bytes[j] += c.bytes[j].load(std::memory_order_relaxed);
+    }
+    stats.writeFailures += c.writeFailures.load(std::memory_order_relaxed);
+    stats.suppressed += c.suppressed.load(std::memory_order_relaxed);
+    stats.truncations += c.truncations.load(std::memory_order_relaxed);
+  }
+  stats.dropped = pImpl->deferredDropped.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void SimpleLog::Impl::closeLogFile()
+{
+  // write pending messages
+  flushOutputBuffer();
+  if (fd >= 0) {
+    unmapLogFile();
+    close(fd);
+    fd = -1;
+  }
+  logFileSize = 0;
+  rotateOffset = SIZE_MAX;
+}
+
+int SimpleLog::Impl::openLogFile(bool isReopen)
+{
+  logFileSize = 0;
+  rotateOffset = SIZE_MAX;
+  if (logFilePath.length() == 0) {
+    return 0;
   }
-  int nBytes = write(fd, buffer, ix);
-  if ((fp != NULL) && (nBytes > 0)) {
-    logFileSize += nBytes;
+  // append mode: each write() goes atomically at the end of file, whatever the number of writers
+  // when mapped, messages are written at reserved offsets (and read access is needed)
+  int flags = (mapStep > 0) ? O_RDWR | O_CREAT : O_WRONLY | O_CREAT | O_APPEND;
+  if ((rotateMaxFiles == 1) && (!isReopen)) {
+    flags |= O_TRUNC;
   }
-  if (nBytes != (int)ix) {
+  int newFd = open(logFilePath.c_str(), flags | O_CLOEXEC, 0666);
+  if (newFd < 0) {
     return -1;
   }
-
+  useLogFile(newFd);
   return 0;
 }
 
-SimpleLog::SimpleLog(const char* logFilePath)
+void SimpleLog::Impl::useLogFile(int newFd)
 {
-  pImpl = std::make_unique<SimpleLog::Impl>();
-  if (pImpl == NULL) {
-    throw __LINE__;
+  fd = newFd;
+  logFileSize = 0;
+  rotateOffset = SIZE_MAX;
+  // get file size - this is where we are (append mode)
+  off_t fs = lseek(fd, 0, SEEK_END);
+  if (fs >= 0) {
+    logFileSize = (size_t)fs;
   }
-  setLogFile(logFilePath);
+  if ((mapStep == 0) || (mapLogFile() != 0)) {
+    // not mapped: use write(), in append mode
+    int flags = fcntl(fd, F_GETFL);
+    if ((flags >= 0) && ((flags & O_APPEND) == 0)) {
+      fcntl(fd, F_SETFL, flags | O_APPEND);
+    }
+  }
+  if (rotatePeriod > 0) {
+    updateRotateTime(time(NULL));
+  }
+  requestNextFile();
 }
 
-SimpleLog::~SimpleLog()
+int SimpleLog::Impl::rotateLogFile()
 {
-  setLogFile(NULL);
+  rotateCount++;
+  if (rotateMaxFiles == 1) {
+    // stop after first file
+    closeLogFile();
+    disableOutput = 1;
+    return -1;
+  }
+  // use the next file created in background, or create it now if not ready
+  std::string nextPath;
+  int nextFd = takeNextFile(nextPath);
+  if (nextFd < 0) {
+    nextPath = getTemporaryPath(logFilePath, "next", ++nextFileIndex);
+    nextFd = open(nextPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  }
+  closeLogFile();
+  if (nextFd < 0) {
+    return -1;
+  }
+  // files are moved to their final place in background
+  std::string pendingPath = getTemporaryPath(logFilePath, "pending", rotateCount);
+  queueRotation({ logFilePath, pendingPath, rotateMaxFiles, nextPath });
+  useLogFile(nextFd);
+  return 0;
 }
 
-int SimpleLog::setLogFile(const char* logFilePath, unsigned long rotateMaxBytes, unsigned int rotateMaxFiles, unsigned int rotateNow)
+void SimpleLog::Impl::updateRotateTime(time_t now)
 {
-  pImpl->closeLogFile();
-  pImpl->logFilePath = "";
-  pImpl->rotateMaxFiles = 0;
-  pImpl->rotateMaxBytes = 0;
-  pImpl->logFileSize = 0;
-  pImpl->disableOutput = 0;
-  if (logFilePath != NULL) {
-    pImpl->logFilePath = logFilePath;
-    if (!strcmp(logFilePath, "/dev/null")) {
-      pImpl->disableOutput = 1;
-      return 0;
-    }
-    pImpl->rotateMaxBytes = rotateMaxBytes;
-    pImpl->rotateMaxFiles = rotateMaxFiles;
-    if (rotateNow) {
-      pImpl->rotate();
-    }
-    if (pImpl->openLogFile()) {
-      return -1;
-    }
+  // periods are aligned on local midnight
+  struct tm t;
+  localtime_r(&now, &t);
+  time_t elapsed = t.tm_hour * 3600 + t.tm_min * 60 + t.tm_sec;
+  if (rotatePeriod <= 24 * 3600) {
+    elapsed = elapsed % rotatePeriod;
   }
-  return 0;
+  rotateTime = now - elapsed + rotatePeriod;
 }
 
-int SimpleLog::info(const char* message, ...)
+void SimpleLog::Impl::requestNextFile()
 {
-  int err = 0;
-
-  va_list ap;
-  va_start(ap, message);
-  err = pImpl->logV(Impl::Severity::Info, message, ap);
-  va_end(ap);
-
-  return err;
+  if (((rotateMaxBytes == 0) && (rotatePeriod == 0)) || (rotateMaxFiles == 1) || (logFilePath.length() == 0)) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(rotateQueueLock);
+  if (nextFileBase == logFilePath) {
+    if ((nextFileFd >= 0) || (nextFileRequested)) {
+      return;
+    }
+  } else if (nextFileFd >= 0) {
+    // file created for another path
+    close(nextFileFd);
+    unlink(nextFilePath.c_str());
+    nextFileFd = -1;
+  }
+  nextFileBase = logFilePath;
+  nextFileRequested = true;
+  startRotation();
+  rotateWakeUp.notify_all();
 }
 
-int SimpleLog::error(const char* message, ...)
+int SimpleLog::Impl::takeNextFile(std::string& path)
 {
-  int err = 0;
-
-  va_list ap;
-  va_start(ap, message);
-  err = pImpl->logV(Impl::Severity::Error, message, ap);
-  va_end(ap);
-
-  return err;
+  std::unique_lock<std::mutex> lock(rotateQueueLock);
+  if ((nextFileFd < 0) || (nextFileBase != logFilePath)) {
+    return -1;
+  }
+  int nextFd = nextFileFd;
+  path = nextFilePath;
+  nextFileFd = -1;
+  return nextFd;
 }
 
-int SimpleLog::warning(const char* message, ...)
+void SimpleLog::Impl::releaseNextFile()
 {
-  int err = 0;
-
-  va_list ap;
-  va_start(ap, message);
-  err = pImpl->logV(Impl::Severity::Warning, message, ap);
-  va_end(ap);
-
-  return err;
+  std::unique_lock<std::mutex> lock(rotateQueueLock);
+  nextFileBase = "";
+  nextFileRequested = false;
+  if (nextFileFd >= 0) {
+    close(nextFileFd);
+    unlink(nextFilePath.c_str());
+    nextFileFd = -1;
+  }
 }
 
-void SimpleLog::setOutputFormat(int opts)
+int SimpleLog::Impl::mapLogFile()
 {
-  pImpl->formatOptions = opts;
+  void* p = mmap(NULL, mapReserveSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    return -1;
+  }
+  mapBase = (char*)p;
+  mapSize = 0;
+  if (extendMapping(logFileSize + 1)) {
+    munmap(mapBase, mapReserveSize);
+    mapBase = nullptr;
+    return -1;
+  }
+  return 0;
 }
 
-void SimpleLog::setFileDescriptors(int fdStdout, int fdStderr)
+void SimpleLog::Impl::unmapLogFile()
 {
-  pImpl->fdStdout = fdStdout;
-  pImpl->fdStderr = fdStderr;
+  if (mapBase == nullptr) {
+    return;
+  }
+  munmap(mapBase, mapReserveSize);
+  mapBase = nullptr;
+  mapSize = 0;
+  // remove preallocated space after content
+  size_t fileSize = logFileSize;
+  if (rotateOffset < fileSize) {
+    fileSize = rotateOffset;
+  }
+  if (ftruncate(fd, fileSize) != 0) {
+    // file content still valid, followed by zero bytes
+  }
 }
 
-void SimpleLog::Impl::closeLogFile()
+int SimpleLog::Impl::extendMapping(size_t minSize)
 {
-  if (fp != NULL) {
-    fclose(fp);
-    fp = NULL;
+  size_t oldSize = mapSize;
+  size_t newSize = ((minSize + mapStep - 1) / mapStep) * mapStep;
+  if (rotateMaxBytes > 0) {
+    // no need to go beyond file size limit
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t maxSize = ((std::max(minSize, (size_t)rotateMaxBytes) + pageSize - 1) / pageSize) * pageSize;
+    if (newSize > maxSize) {
+      newSize = maxSize;
+    }
   }
-  logFileSize = 0;
+  if ((newSize > mapReserveSize) || (newSize <= oldSize)) {
+    return -1;
+  }
+  if (fallocate(fd, 0, oldSize, newSize - oldSize)) {
+    // not supported by filesystem: extend file without preallocation
+    if (ftruncate(fd, newSize)) {
+      return -1;
+    }
+  }
+  if (mmap(mapBase + oldSize, newSize - oldSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, oldSize) == MAP_FAILED) {
+    return -1;
+  }
+  mapSize.store(newSize, std::memory_order_release);
+  return 0;
 }
 
-int SimpleLog::Impl::openLogFile()
+int SimpleLog::Impl::writeMapped(const char* buffer, size_t size, size_t offset)
 {
-  logFileSize = 0;
-  if (logFilePath.length() == 0) {
-    return 0;
+  if (offset + size > mapSize.load(std::memory_order_acquire)) {
+    std::unique_lock<std::mutex> lock(mapLock);
+    if (offset + size > mapSize.load(std::memory_order_relaxed)) {
+      extendMapping(offset + size);
+    }
   }
-  const char* mode = "a";
-  if (rotateMaxFiles == 1) {
-    mode = "w";
+  if (offset + size <= mapSize.load(std::memory_order_acquire)) {
+    memcpy(mapBase + offset, buffer, size);
+    return 0;
   }
-  fp = fopen(logFilePath.c_str(), mode);
-  if (fp == NULL) {
+  // mapping could not be extended: write to file directly, at the reserved place
+  ssize_t nBytes = pwrite(fd, buffer, size, offset);
+  if (nBytes != (ssize_t)size) {
     return -1;
   }
-  // get file size - this is where we are (append mode)
-  long fs = ftell(fp);
-  if (fs >= 0) {
-    logFileSize = (size_t)fs;
-  }
   return 0;
 }
 
-void SimpleLog::Impl::rotate()
+void SimpleLog::setLogRotateCompression(RotateCompression compression)
+{
+  pImpl->rotateCompression = compression;
+}
+
+void SimpleLog::setLogRotatePeriod(unsigned int period)
+{
+  std::unique_lock<std::shared_mutex> lock(pImpl->fileLock);
+  pImpl->rotatePeriod = period;
+  if (period > 0) {
+    pImpl->updateRotateTime(time(NULL));
+    if (pImpl->fd >= 0) {
+      pImpl->requestNextFile();
+    }
+  }
+}
+
+std::string SimpleLog::Impl::getTemporaryPath(const std::string& logFilePath, const char* kind, unsigned long index) const
+{
+  return logFilePath + "." + kind + "." + std::to_string(getpid()) + "." + std::to_string(instanceId) + "." + std::to_string(index);
+}
+
+bool SimpleLog::Impl::checkRotatedFiles(const std::string& logFilePath, const std::vector<SimpleLogRotatedFile>& files)
 {
+  // one more index than listed is checked, it is the first one used by shiftRotatedFiles() when there is no hole
+  unsigned int maxIndex = (files.size() > 0) ? files.back().index + 1 : 1;
+  size_t pos = 0;
+  for (unsigned int index = 1; index <= maxIndex; index++) {
+    const SimpleLogRotatedFile* file = nullptr;
+    if ((pos < files.size()) && (files[pos].index == index)) {
+      file = &files[pos++];
+    }
+    for (const char* suffix : { "", ".gz", ".zst" }) {
+      std::string path = logFilePath + "." + std::to_string(index) + suffix;
+      bool isListed = (file != nullptr) && (file->path == path);
+      if ((access(path.c_str(), F_OK) == 0) != isListed) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
 
+void SimpleLog::Impl::scanRotatedFiles(const std::string& logFilePath, bool includeCurrent, std::vector<SimpleLogRotatedFile>& files)
+{
+  files.clear();
   if (logFilePath.length() == 0) {
     return;
   }
@@ -309,11 +2849,7 @@ void SimpleLog::Impl::rotate()
     dirName = "./";
   }
 
-  // build list of file indexes to be rotated
-  std::vector<unsigned int> rotateIx;
-
-  // scan directory for matching file names = filename.12345
-  // and append list of indexes to be rotated
+  // scan directory for matching file names = filename.12345, possibly followed by a compression extension
   //
   // would love to use std::filesystem but not readily available with O2/gcc 7.3.0
   // needs include experimental/ + use link flag -lstdc++fs
@@ -328,7 +2864,9 @@ void SimpleLog::Impl::rotate()
       if (!strcmp(fileName.c_str(), ep->d_name)) {
         // we use index 0 for base file name, without extensions.
         // other indexes start with 1
-        rotateIx.push_back(0);
+        if (includeCurrent) {
+          files.push_back({ 0, logFilePath, "" });
+        }
         continue;
       }
       if (strlen(ep->d_name) <= fileName.length() + 1) {
@@ -341,30 +2879,118 @@ void SimpleLog::Impl::rotate()
         continue;
       }
       std::string postfix = &ep->d_name[fileName.length() + 1];
-      bool isOk = 1;
-      for (const char& c : postfix) {
-        if (!isdigit(c)) {
-          isOk = 0;
-          break;
-        }
+      size_t nDigits = 0;
+      while ((nDigits < postfix.length()) && (isdigit(postfix[nDigits]))) {
+        nDigits++;
+      }
+      std::string suffix = postfix.substr(nDigits);
+      if ((nDigits == 0) || (nDigits > 9)) {
+        continue;
       }
-      if (isOk) {
-        rotateIx.push_back(std::stoi(postfix));
+      if ((suffix != "") && (suffix != ".gz") && (suffix != ".zst")) {
+        continue;
       }
+      files.push_back({ (unsigned int)std::stoi(postfix.substr(0, nDigits)), dirName + ep->d_name, suffix });
     }
     closedir(dp);
   }
 
   // sort indexes in order
-  std::sort(rotateIx.begin(), rotateIx.end());
+  std::sort(files.begin(), files.end(), [](const SimpleLogRotatedFile& a, const SimpleLogRotatedFile& b) { return a.index < b.index; });
+}
+
+void SimpleLog::Impl::recoverRotatedFiles()
+{
+  std::string dirName;
+  std::string fileName;
+  size_t pos = logFilePath.find_last_of('/');
+  if (pos != std::string::npos) {
+    fileName = logFilePath.substr(pos + 1);
+    dirName = logFilePath.substr(0, pos + 1);
+  } else {
+    fileName = logFilePath;
+    dirName = "./";
+  }
+
+  // list temporary files of processes not running anymore, with their modification time
+  std::vector<std::pair<struct timespec, std::string>> leftovers;
+  DIR* dp = opendir(dirName.c_str());
+  if (dp == NULL) {
+    return;
+  }
+  for (;;) {
+    struct dirent* ep = readdir(dp);
+    if (ep == NULL) {
+      break;
+    }
+    if ((strncmp(fileName.c_str(), ep->d_name, fileName.length())) || (ep->d_name[fileName.length()] != '.')) {
+      continue;
+    }
+    // name is kind.pid.instanceId.index, possibly followed by a compression extension
+    const char* postfix = &ep->d_name[fileName.length() + 1];
+    const char* kinds[] = { "pending.", "next.", "compress." };
+    size_t kind = 0;
+    while ((kind < 3) && (strncmp(postfix, kinds[kind], strlen(kinds[kind])))) {
+      kind++;
+    }
+    if (kind == 3) {
+      continue;
+    }
+    char* end = nullptr;
+    long pid = strtol(postfix + strlen(kinds[kind]), &end, 10);
+    if ((pid <= 0) || (*end != '.') || (pid == getpid()) || (kill((pid_t)pid, 0) == 0) || (errno != ESRCH)) {
+      continue;
+    }
+    std::string path = dirName + ep->d_name;
+    struct stat st;
+    if (kind == 2) {
+      unlink(path.c_str());
+    } else if (stat(path.c_str(), &st) == 0) {
+      if ((st.st_size == 0) && (kind == 1)) {
+        unlink(path.c_str());
+      } else {
+        leftovers.push_back({ st.st_mtim, path });
+      }
+    }
+  }
+  closedir(dp);
+  if (leftovers.size() == 0) {
+    return;
+  }
 
+  std::sort(leftovers.begin(), leftovers.end(), [](const auto& a, const auto& b) {
+    return (a.first.tv_sec < b.first.tv_sec) || ((a.first.tv_sec == b.first.tv_sec) && (a.first.tv_nsec < b.first.tv_nsec));
+  });
+
+  // the most recent one replaces the log file, if missing (the log file itself is never moved, other writers may use it).
+  // link() does not replace the log file if created meanwhile, unlike rename()
+  std::unique_lock<std::mutex> filesLock(rotateFilesLock);
+  struct stat st;
+  if ((stat(logFilePath.c_str(), &st) != 0) && (link(leftovers.back().second.c_str(), logFilePath.c_str()) == 0)) {
+    unlink(leftovers.back().second.c_str());
+    leftovers.pop_back();
+  }
+
+  // rotate the others from the oldest
+  std::vector<SimpleLogRotatedFile> files;
+  scanRotatedFiles(logFilePath, false, files);
+  for (size_t i = 0; i < leftovers.size(); i++) {
+    files.insert(files.begin(), { 0, leftovers[i].second, "" });
+    shiftRotatedFiles(logFilePath, files, rotateMaxFiles);
+  }
+  rotatedFiles = files;
+  rotatedFilesBase = logFilePath;
+}
+
+void SimpleLog::Impl::shiftRotatedFiles(const std::string& logFilePath, std::vector<SimpleLogRotatedFile>& files, unsigned int maxFiles)
+{
   // find a free slot ('hole') in existing index list
   // before this -> rename in decreasing order
   // after this (included) -> rename in increasing order
-  unsigned int holePos = 0; // position in rotateIx[] of first index after hole
+  unsigned int holePos = 0; // position in files[] of first index after hole
   unsigned int holeIx = 1;  // value of contiguous id that shall be used for this hole
-  for (; holePos < rotateIx.size(); holePos++) {
-    if (holeIx != rotateIx[holePos] + 1) {
+  for (; holePos < files.size(); holePos++) {
+    if (holeIx != files[holePos].index + 1) {
       // found a hole
       break;
     }
@@ -372,24 +2998,20 @@ void SimpleLog::Impl::rotate()
   }
 
   // function to rotate file (rename +1 or delete)
-  auto rotateFile = [&](unsigned int oldIndex, unsigned int newIndex) {
-    std::string inFile;
-    if (oldIndex == 0) {
-      // index 0 is reserved for base file name
-      inFile = dirName + fileName;
-    } else {
-      inFile = dirName + fileName + "." + std::to_string(oldIndex);
-    }
-    if ((newIndex >= rotateMaxFiles) && (rotateMaxFiles != 0)) {
+  auto rotateFile = [&](SimpleLogRotatedFile& file, unsigned int newIndex) {
+    if ((newIndex >= maxFiles) && (maxFiles != 0)) {
       // this file should be removed
-      unlink(inFile.c_str());
+      unlink(file.path.c_str());
+      file.path = "";
     } else {
       // this file should be renamed (if necessary)
-      if (oldIndex != newIndex) {
-        std::string outFile = dirName + fileName + "." + std::to_string(newIndex);
-        rename(inFile.c_str(), outFile.c_str());
+      if (file.index != newIndex) {
+        std::string outFile = logFilePath + "." + std::to_string(newIndex) + file.suffix;
+        rename(file.path.c_str(), outFile.c_str());
+        file.path = outFile;
       }
     }
+    file.index = newIndex;
   };
 
   unsigned int newIx; // counter for new file index
@@ -397,16 +3019,271 @@ void SimpleLog::Impl::rotate()
   // before hole, rename files (increment up) in backward order (newIx >= oldIx)
   newIx = holeIx - 1;
   for (int i = (int)(holePos)-1; i >= 0; i--) {
-    rotateFile(rotateIx[i], newIx);
+    rotateFile(files[i], newIx);
     newIx--;
   }
 
   // after hole, rename files (pack down) in increasing order (newIx <= oldIx)
   newIx = holeIx;
-  for (unsigned int i = holePos; i < rotateIx.size(); i++) {
-    rotateFile(rotateIx[i], newIx);
+  for (unsigned int i = holePos; i < files.size(); i++) {
+    rotateFile(files[i], newIx);
     newIx++;
   }
+
+  // remove deleted files from list
+  files.erase(std::remove_if(files.begin(), files.end(), [](const SimpleLogRotatedFile& f) { return f.path.length() == 0; }), files.end());
+}
+
+void SimpleLog::Impl::rotate()
+{
+  if (logFilePath.length() == 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(rotateFilesLock);
+  std::vector<SimpleLogRotatedFile> files;
+  scanRotatedFiles(logFilePath, true, files);
+  shiftRotatedFiles(logFilePath, files, rotateMaxFiles);
+  // list of rotated files is now known
+  rotatedFiles = files;
+  rotatedFilesBase = logFilePath;
+}
+
+// check that a gzip file is complete, from its trailer: size of uncompressed data, modulo 2^32 (RFC 1952)
+static bool isGzipComplete(int fd, off_t inputSize)
+{
+  unsigned char header[2];
+  unsigned char trailer[4];
+  off_t size = lseek(fd, 0, SEEK_END);
+  if ((size < 18) || (pread(fd, header, sizeof(header), 0) != sizeof(header)) || (pread(fd, trailer, sizeof(trailer), size - 4) != sizeof(trailer))) {
+    return false;
+  }
+  uint32_t isize = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+  return (header[0] == 0x1f) && (header[1] == 0x8b) && (isize == (uint32_t)inputSize);
+}
+
+void SimpleLog::Impl::compressRotatedFile(const SimpleLogCompressTask& task)
+{
+  const char* suffix;
+  std::vector<const char*> argv;
+  int compression = rotateCompression;
+  if (compression == SimpleLog::RotateCompression::RotateGzip) {
+    suffix = ".gz";
+    argv = { "gzip", "-c", "-q", NULL };
+  } else if (compression == SimpleLog::RotateCompression::RotateZstd) {
+    suffix = ".zst";
+    argv = { "zstd", "-c", "-q", NULL };
+  } else {
+    return;
+  }
+
+  // find the file in the list of rotated files, it may have been renamed in the meantime. Must be called with rotateFilesLock.
+  auto findFile = [&]() -> SimpleLogRotatedFile* {
+    if (rotatedFilesBase != task.logFilePath) {
+      return nullptr;
+    }
+    for (auto& file : rotatedFiles) {
+      struct stat st;
+      if ((file.suffix.length() == 0) && (stat(file.path.c_str(), &st) == 0) && (st.st_ino == task.inode)) {
+        return &file;
+      }
+    }
+    return nullptr;
+  };
+
+  // open the file, it remains readable (and its inode is not reused) even if renamed or removed while compressing
+  int inFd = -1;
+  {
+    std::unique_lock<std::mutex> filesLock(rotateFilesLock);
+    SimpleLogRotatedFile* file = findFile();
+    if (file != nullptr) {
+      inFd = open(file->path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+  }
+  if (inFd < 0) {
+    return;
+  }
+
+  // compress to a temporary file, which is not matched by scanRotatedFiles()
+  std::string tmpPath = getTemporaryPath(task.logFilePath, "compress", task.inode) + suffix;
+  bool isCompressed = false;
+  // descriptors are not inherited by the compression command (except as its stdin/stdout), in particular the log file
+  int outFd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (outFd >= 0) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, inFd, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, outFd, STDOUT_FILENO);
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], &actions, NULL, (char* const*)argv.data(), environ) == 0) {
+      int status = 0;
+      pid_t err;
+      while (((err = waitpid(pid, &status, 0)) == -1) && (errno == EINTR)) {
+      }
+      if ((err == -1) && (errno == ECHILD)) {
+        // exit status not available, when the application ignores SIGCHLD (child reaped automatically, once terminated): check output instead
+        struct stat st;
+        isCompressed = (compression == SimpleLog::RotateCompression::RotateGzip) && (fstat(inFd, &st) == 0) && isGzipComplete(outFd, st.st_size);
+        if (!isCompressed) {
+          logInternal(SimpleLog::Severity::Warning, "Log compression failed: exit status of %s not available (SIGCHLD ignored)", argv[0]);
+        }
+      } else {
+        isCompressed = (err == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+      }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(outFd);
+  }
+
+  // replace the file by its compressed version, unless removed by a rotation in the meantime
+  {
+    std::unique_lock<std::mutex> filesLock(rotateFilesLock);
+    SimpleLogRotatedFile* file = isCompressed ? findFile() : nullptr;
+    if ((file != nullptr) && (rename(tmpPath.c_str(), (file->path + suffix).c_str()) == 0)) {
+      unlink(file->path.c_str());
+      file->path += suffix;
+      file->suffix = suffix;
+    } else if (outFd >= 0) {
+      unlink(tmpPath.c_str());
+    }
+  }
+  close(inFd);
+}
+
+void SimpleLog::Impl::queueRotation(const SimpleLogRotateTask& task)
+{
+  std::unique_lock<std::mutex> lock(rotateQueueLock);
+  rotateQueue.push_back(task);
+  startRotation();
+  rotateWakeUp.notify_all();
+}
+
+void SimpleLog::Impl::startRotation()
+{
+  if (!rotateThread.joinable()) {
+    rotateShutdown = false;
+    rotateThread = std::thread(&SimpleLog::Impl::rotateLoop, this);
+  }
+}
+
+void SimpleLog::Impl::rotateLoop()
+{
+  std::unique_lock<std::mutex> lock(rotateQueueLock);
+  for (;;) {
+    if (rotateQueue.empty()) {
+      if (nextFileRequested) {
+        // create next log file, and keep it unless it is not wanted anymore
+        nextFileRequested = false;
+        std::string base = nextFileBase;
+        std::string path = getTemporaryPath(base, "next", ++nextFileIndex);
+        lock.unlock();
+        int newFd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        lock.lock();
+        if (newFd >= 0) {
+          if ((nextFileBase == base) && (nextFileFd < 0)) {
+            nextFileFd = newFd;
+            nextFilePath = path;
+          } else {
+            close(newFd);
+            unlink(path.c_str());
+          }
+        }
+        continue;
+      }
+      if (!compressQueue.empty()) {
+        // compressions are done last, without blocking waitRotations()
+        SimpleLogCompressTask compressTask = compressQueue.front();
+        compressQueue.pop_front();
+        lock.unlock();
+        compressRotatedFile(compressTask);
+        lock.lock();
+        continue;
+      }
+      if (rotateShutdown) {
+        break;
+      }
+      rotateWakeUp.wait(lock);
+      continue;
+    }
+    SimpleLogRotateTask task = rotateQueue.front();
+    rotateQueue.pop_front();
+    rotateBusy = true;
+    lock.unlock();
+
+    // files are renamed with rotateFilesLock, and compressed later
+    SimpleLogCompressTask compressTask = { task.logFilePath, 0 };
+    int renameError = 0;
+    {
+      std::unique_lock<std::mutex> filesLock(rotateFilesLock);
+      if ((rotatedFilesBase != task.logFilePath) || (!checkRotatedFiles(task.logFilePath, rotatedFiles))) {
+        // first rotation for this file, or files rotated by another writer: get list of existing files
+        scanRotatedFiles(task.logFilePath, false, rotatedFiles);
+        rotatedFilesBase = task.logFilePath;
+      }
+      bool isMoved = true;
+      if (task.nextPath.length() > 0) {
+        // move the file just rotated aside, and put the next one in place.
+        // On failure, files are left where they are (the next file keeps its temporary name), so that no content is lost.
+        isMoved = (rename(task.logFilePath.c_str(), task.pendingPath.c_str()) == 0);
+        if (isMoved) {
+          rename(task.nextPath.c_str(), task.logFilePath.c_str());
+        } else {
+          renameError = errno;
+        }
+      }
+      if (isMoved) {
+        // the file just rotated becomes the most recent one
+        rotatedFiles.insert(rotatedFiles.begin(), { 0, task.pendingPath, "" });
+        shiftRotatedFiles(task.logFilePath, rotatedFiles, task.rotateMaxFiles);
+        struct stat st;
+        if ((rotatedFiles.size() > 0) && (rotatedFiles[0].index == 1) && (rotatedFiles[0].suffix.length() == 0) && (rotateCompression != SimpleLog::RotateCompression::RotateNoCompression) && (stat(rotatedFiles[0].path.c_str(), &st) == 0)) {
+          compressTask.inode = st.st_ino;
+        }
+      }
+    }
+
+    if (renameError) {
+      logInternal(SimpleLog::Severity::Error, "Log rotation failed: can not rename %s: %s (current file is %s)", task.logFilePath.c_str(), strerror(renameError), task.nextPath.c_str());
+    }
+
+    lock.lock();
+    if (compressTask.inode != 0) {
+      compressQueue.push_back(compressTask);
+    }
+    rotateBusy = false;
+    rotateWakeUp.notify_all();
+  }
+}
+
+void SimpleLog::Impl::waitRotations()
+{
+  std::unique_lock<std::mutex> lock(rotateQueueLock);
+  rotateWakeUp.wait(lock, [&] { return rotateQueue.empty() && !rotateBusy; });
+}
+
+void SimpleLog::Impl::lockFileIdle(std::unique_lock<std::shared_mutex>& lock)
+{
+  for (;;) {
+    waitRotations();
+    lock.lock();
+    // rotations are queued with fileLock in exclusive mode: none can be added until it is released
+    std::unique_lock<std::mutex> queueLock(rotateQueueLock);
+    if (rotateQueue.empty() && !rotateBusy) {
+      return;
+    }
+    queueLock.unlock();
+    lock.unlock();
+  }
 }
 
-/// \todo: thread to flush output every 1 second
+void SimpleLog::Impl::stopRotation()
+{
+  {
+    std::unique_lock<std::mutex> lock(rotateQueueLock);
+    if (!rotateThread.joinable()) {
+      return;
+    }
+    rotateShutdown = true;
+    rotateWakeUp.notify_all();
+  }
+  rotateThread.join();
+}
@@ -10,10 +10,34 @@
 // or submit itself to any jurisdiction.
 
 #include <Common/Thread.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 using namespace AliceO2::Common;
 
+// add to a counter with a single writer: no need for an atomic read-modify-write
+static inline void addToCounter(std::atomic<unsigned long long>& counter, unsigned long long value)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// hint to the CPU that we are in a spin-wait loop
+static inline void cpuPause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
 Thread::Thread(Thread::CallbackResult (*vLoopCallback)(void*), void* vLoopArg, std::string vThreadName, int vLoopSleepTime)
 {
   shutdown = 0;
@@ -23,6 +47,23 @@ Thread::Thread(Thread::CallbackResult (*vLoopCallback)(void*), void* vLoopArg, s
   loopCallback = vLoopCallback;
   loopArg = vLoopArg;
   loopSleepTime = vLoopSleepTime;
+  startStatus = NULL;
+  backoffSpin = 0;
+  backoffPause = 0;
+  backoffYield = 0;
+  backoffMinSleep = 0;
+  wakeCount = 0;
+  sleeping = 0;
+  for (auto& c : statsIterations) {
+    c = 0;
+  }
+  for (auto& c : statsHistogram) {
+    c = 0;
+  }
+  statsBusyTime = 0;
+  statsIdleTime = 0;
+  // if not available, sleep can not be interrupted
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 }
 
 Thread::~Thread()
@@ -31,22 +72,36 @@ Thread::~Thread()
     stop();
     join();
   }
+  if (wakeFd >= 0) {
+    close(wakeFd);
+  }
 }
 
-void Thread::start()
+int Thread::start(std::string* errorMessage)
 {
+  int status = 0;
   if (theThread == NULL) {
     shutdown = 0;
     running = 0;
+    // wait until thread options are applied
+    std::promise<int> started;
+    std::future<int> startedFuture = started.get_future();
+    startStatus = &started;
     theThread = new std::thread(threadMain, this);
+    status = startedFuture.get();
+    startStatus = NULL;
+    if (errorMessage != nullptr) {
+      *errorMessage = startError;
+    }
   }
-  return;
+  return status;
 }
 
 void Thread::stop()
 {
   if (theThread != NULL) {
     shutdown = 1;
+    wake();
   }
 }
 
@@ -54,6 +109,7 @@ void Thread::join()
 {
   if (theThread != NULL) {
     shutdown = 1;
+    wake();
     theThread->join();
     delete theThread;
     theThread = NULL;
@@ -63,9 +119,20 @@ void Thread::join()
 
 void Thread::threadMain(Thread* e)
 {
+  // apply thread options before first loop call
+  ThreadOptions threadOptions = e->options;
+  if (threadOptions.name.length() == 0) {
+    threadOptions.name = e->name;
+  }
+  e->startError.clear();
+  e->startStatus->set_value(applyThreadOptions(threadOptions, e->startError));
+
   e->running = 1;
   int maxIterOnShutdown = 100;
   int nIterOnShutdown = 0;
+  int nIdle = 0; // number of consecutive idle iterations
+  std::chrono::steady_clock::time_point tEnd; // end of previous loop call
+  bool wasIdle = false;                       // set when previous loop call was idle
 
   for (;;) {
     if (e->shutdown) {
@@ -73,14 +140,23 @@ void Thread::threadMain(Thread* e)
         break;
       nIterOnShutdown++;
     }
+    unsigned long wakeCountBefore = e->wakeCount;
+    auto tBegin = std::chrono::steady_clock::now();
+    if (wasIdle) {
+      // waiting after previous idle call
+      addToCounter(e->statsIdleTime, std::chrono::duration_cast<std::chrono::nanoseconds>(tBegin - tEnd).count());
+    }
     int r = e->doLoop();
+    tEnd = std::chrono::steady_clock::now();
+    e->updateStats(r, std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tBegin).count());
+    wasIdle = (r == Thread::CallbackResult::Idle);
     if (r == Thread::CallbackResult::Ok) {
+      nIdle = 0;
     } else if (r == Thread::CallbackResult::Idle) {
       if (e->shutdown)
         break; // exit immediately on shutdown
-      if (e->loopSleepTime > 0) {
-        usleep(e->loopSleepTime);
-      }
+      e->idleWait(nIdle, wakeCountBefore);
+      nIdle++;
     } else if (r == Thread::CallbackResult::Error) {
       // account this error... maybe do something if repetitive
       if (e->shutdown)
@@ -104,3 +180,141 @@ std::string Thread::getName()
 {
   return name;
 }
+
+void Thread::updateStats(int result, unsigned long long duration)
+{
+  if ((result >= 0) && (result < Stats::nResults)) {
+    addToCounter(statsIterations[result], 1);
+  }
+  addToCounter((result == Thread::CallbackResult::Idle) ? statsIdleTime : statsBusyTime, duration);
+  int bin = 0;
+  if (duration > 1) {
+    bin = std::min(63 - __builtin_clzll(duration), Stats::nHistogramBins - 1);
+  }
+  addToCounter(statsHistogram[bin], 1);
+}
+
+Thread::Stats Thread::getStats() const
+{
+  Stats stats;
+  for (int i = 0; i < Stats::nResults; i++) {
+    stats.iterations[i] = statsIterations[i].load(std::memory_order_relaxed);
+  }
+  stats.busyTime = statsBusyTime.load(std::memory_order_relaxed);
+  stats.idleTime = statsIdleTime.load(std::memory_order_relaxed);
+  for (int i = 0; i < Stats::nHistogramBins; i++) {
+    stats.durationHistogram[i] = statsHistogram[i].load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+double Thread::Stats::getDutyCycle() const
+{
+  unsigned long long total = busyTime + idleTime;
+  if (total == 0) {
+    return 0;
+  }
+  return (double)busyTime / total;
+}
+
+unsigned long long Thread::Stats::getDurationPercentile(double fraction) const
+{
+  unsigned long long total = 0;
+  for (int i = 0; i < nHistogramBins; i++) {
+    total += durationHistogram[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  unsigned long long count = 0;
+  for (int i = 0; i < nHistogramBins; i++) {
+    count += durationHistogram[i];
+    if (count >= fraction * total) {
+      return 2ULL << i;
+    }
+  }
+  return 2ULL << (nHistogramBins - 1);
+}
+
+void Thread::setThreadOptions(const ThreadOptions& vOptions)
+{
+  options = vOptions;
+}
+
+void Thread::setIdleBackoff(int nSpin, int nPause, int nYield, int minSleepTime)
+{
+  backoffSpin = nSpin;
+  backoffPause = nPause;
+  backoffYield = nYield;
+  backoffMinSleep = minSleepTime;
+}
+
+void Thread::wake()
+{
+  wakeCount++;
+  // system call only if needed
+  if ((sleeping) && (wakeFd >= 0)) {
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+      return; // counter full, thread will be woken up anyway
+    }
+  }
+}
+
+void Thread::idleWait(int nIdle, unsigned long wakeCountBefore)
+{
+  if (backoffMinSleep <= 0) {
+    sleep(loopSleepTime, wakeCountBefore);
+    return;
+  }
+  if (nIdle < backoffSpin) {
+    return;
+  }
+  nIdle -= backoffSpin;
+  if (nIdle < backoffPause) {
+    cpuPause();
+    return;
+  }
+  nIdle -= backoffPause;
+  if (nIdle < backoffYield) {
+    sched_yield();
+    return;
+  }
+  nIdle -= backoffYield;
+  // exponential sleep, up to loopSleepTime
+  int sleepTime = loopSleepTime;
+  if ((nIdle < 30) && (((long)backoffMinSleep << nIdle) < loopSleepTime)) {
+    sleepTime = backoffMinSleep << nIdle;
+  }
+  sleep(sleepTime, wakeCountBefore);
+}
+
+void Thread::sleep(int sleepTime, unsigned long wakeCountBefore)
+{
+  if (sleepTime <= 0) {
+    return;
+  }
+  if (wakeFd < 0) {
+    usleep(sleepTime);
+    return;
+  }
+  // flag set before checking for wake-up: either wake() sees it and notifies, or it was called before and sleep is skipped
+  sleeping = 1;
+  if ((wakeCount == wakeCountBefore) && (!shutdown)) {
+    struct pollfd pfd;
+    pfd.fd = wakeFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    struct timespec ts;
+    ts.tv_sec = sleepTime / 1000000;
+    ts.tv_nsec = (sleepTime % 1000000) * 1000;
+    if (ppoll(&pfd, 1, &ts, NULL) > 0) {
+      // reset counter
+      uint64_t value;
+      if (read(wakeFd, &value, sizeof(value)) < 0) {
+        value = 0; // nothing to reset
+      }
+    }
+  }
+  sleeping = 0;
+}
@@ -0,0 +1,139 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include <Common/ThreadOptions.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace AliceO2
+{
+namespace Common
+{
+
+// append description of a failed setting to error message
+static void addError(std::string& errorMessage, const std::string& what, int err)
+{
+  if (errorMessage.length() > 0) {
+    errorMessage += ", ";
+  }
+  errorMessage += what + ": " + strerror(err);
+}
+
+int applyThreadOptions(const ThreadOptions& options, std::string& errorMessage)
+{
+  errorMessage.clear();
+
+  if (options.cpuSet.size() > 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    bool isValid = true;
+    for (int cpu : options.cpuSet) {
+      if ((cpu < 0) || (cpu >= CPU_SETSIZE)) {
+        isValid = false;
+        break;
+      }
+      CPU_SET(cpu, &cpus);
+    }
+    int err = isValid ? pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) : EINVAL;
+    if (err) {
+      addError(errorMessage, "failed to set CPU affinity", err);
+    }
+  }
+
+  if (options.schedulingPolicy >= 0) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    if ((options.schedulingPolicy == SCHED_FIFO) || (options.schedulingPolicy == SCHED_RR)) {
+      param.sched_priority = options.schedulingPriority;
+    }
+    int err = pthread_setschedparam(pthread_self(), options.schedulingPolicy, &param);
+    if (err) {
+      addError(errorMessage, "failed to set scheduling policy " + std::to_string(options.schedulingPolicy) + " priority " + std::to_string(param.sched_priority), err);
+    }
+  }
+
+  if (options.niceValue != 0) {
+    // on Linux, the nice value is per thread
+    if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), options.niceValue) != 0) {
+      addError(errorMessage, "failed to set nice value " + std::to_string(options.niceValue), errno);
+    }
+  }
+
+  if (options.name.length() > 0) {
+    // kernel limit: 16 bytes including terminating null
+    std::string name = options.name.substr(0, 15);
+    int err = pthread_setname_np(pthread_self(), name.c_str());
+    if (err) {
+      addError(errorMessage, "failed to set thread name " + name, err);
+    }
+  }
+
+  return (errorMessage.length() > 0) ? -1 : 0;
+}
+
+int parseCpuList(const std::string& list, std::vector<int>& cpuSet)
+{
+  cpuSet.clear();
+  size_t pos = 0;
+  while (pos < list.length()) {
+    size_t next = list.find(',', pos);
+    if (next == std::string::npos) {
+      next = list.length();
+    }
+    std::string item = list.substr(pos, next - pos);
+    const char* s = item.c_str();
+    char* end;
+    long first = strtol(s, &end, 10);
+    long last = first;
+    if (end == s) {
+      return -1;
+    }
+    if (*end == '-') {
+      s = end + 1;
+      last = strtol(s, &end, 10);
+      if (end == s) {
+        return -1;
+      }
+    }
+    if ((*end != 0) || (first < 0) || (last < first) || (last >= CPU_SETSIZE)) {
+      return -1;
+    }
+    for (long cpu = first; cpu <= last; cpu++) {
+      cpuSet.push_back((int)cpu);
+    }
+    pos = next + 1;
+  }
+  return 0;
+}
+
+int parseSchedulingPolicy(const std::string& name)
+{
+  static const struct {
+    const char* name;
+    int policy;
+  } policies[] = { { "other", SCHED_OTHER }, { "batch", SCHED_BATCH }, { "idle", SCHED_IDLE }, { "fifo", SCHED_FIFO }, { "rr", SCHED_RR } };
+  for (const auto& p : policies) {
+    if (strcasecmp(name.c_str(), p.name) == 0) {
+      return p.policy;
+    }
+  }
+  return -1;
+}
+
+} // namespace Common
+} // namespace AliceO2
@@ -0,0 +1,345 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include <Common/ThreadPool.h>
+#include <deque>
+#include <thread>
+
+namespace AliceO2
+{
+namespace Common
+{
+
+// worker of the pool executing the calling thread, if any
+static thread_local const ThreadPool* threadPoolCurrent = nullptr;
+static thread_local int threadPoolCurrentWorker = -1;
+
+// idle backoff of workers: spin and yield a little, then sleep up to a millisecond
+static const int workerSleepTime = 1000;    // maximum sleep time when idle, in microseconds
+static const int workerBackoffSpin = 100;   // idle iterations without waiting
+static const int workerBackoffPause = 100;  // idle iterations with a CPU pause
+static const int workerBackoffYield = 10;   // idle iterations with a yield
+static const int workerBackoffMinSleep = 5; // first sleep time, in microseconds
+
+struct ThreadPool::Worker {
+  ThreadPool* pool;               // pool of this worker
+  int index;                      // index of this worker in pool
+  std::mutex tasksLock;           // lock for tasks
+  std::deque<Task> tasks;         // queue of tasks: owner takes from back, thieves from front
+  std::unique_ptr<Thread> thread; // thread executing the worker loop
+};
+
+ThreadPool::ThreadPool(int nWorkers, const std::string& name, const std::vector<ThreadOptions>& workerOptions, std::string* errorMessage)
+{
+  nextWorker = 0;
+  nPending = 0;
+  nWaiting = 0;
+  isStopping = false;
+  stopFlag = nullptr;
+  if (nWorkers <= 0) {
+    nWorkers = std::max(1, (int)std::thread::hardware_concurrency());
+  }
+  for (int i = 0; i < nWorkers; i++) {
+    auto w = std::make_unique<Worker>();
+    w->pool = this;
+    w->index = i;
+    w->thread = std::make_unique<Thread>(workerLoop, w.get(), name + "-" + std::to_string(i), workerSleepTime);
+    w->thread->setIdleBackoff(workerBackoffSpin, workerBackoffPause, workerBackoffYield, workerBackoffMinSleep);
+    if ((size_t)i < workerOptions.size()) {
+      w->thread->setThreadOptions(workerOptions[i]);
+    }
+    workers.push_back(std::move(w));
+  }
+  // all workers created before starting, they may steal from each other
+  std::string errors;
+  for (auto& w : workers) {
+    std::string error;
+    if (w->thread->start(&error)) {
+      errors += ((errors.length() > 0) ? "; worker " : "worker ") + std::to_string(w->index) + ": " + error;
+    }
+  }
+  if (errorMessage != nullptr) {
+    *errorMessage = errors;
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  stop(true);
+}
+
+int ThreadPool::getCurrentWorker() const
+{
+  return (threadPoolCurrent == this) ? threadPoolCurrentWorker : -1;
+}
+
+int ThreadPool::push(Task task)
+{
+  if (addPending(1)) {
+    return -1;
+  }
+  int self = getCurrentWorker();
+  int target = (self >= 0) ? self : (int)(nextWorker++ % workers.size());
+  Worker& w = *workers[target];
+  {
+    std::lock_guard<std::mutex> lock(w.tasksLock);
+    w.tasks.push_back(std::move(task));
+  }
+  w.thread->wake();
+  if (self >= 0) {
+    // busy worker: another one may steal the task
+    workers[(self + 1) % workers.size()]->thread->wake();
+  }
+  return 0;
+}
+
+std::future<void> ThreadPool::submitBatch(std::vector<std::function<void()>> tasks)
+{
+  // shared state of the batch: completed when the last task is done
+  struct Batch {
+    std::atomic<size_t> remaining;
+    std::promise<void> done;
+    std::mutex errorLock;
+    std::exception_ptr error;
+  };
+  auto batch = std::make_shared<Batch>();
+  batch->remaining = tasks.size();
+  std::future<void> result = batch->done.get_future();
+  if (tasks.size() == 0) {
+    batch->done.set_value();
+    return result;
+  }
+  if (addPending(tasks.size())) {
+    batch->done.set_exception(std::make_exception_ptr(std::runtime_error("ThreadPool stopped")));
+    return result;
+  }
+
+  // distribute tasks in contiguous blocks, one lock per queue
+  size_t nWorkers = workers.size();
+  size_t first = nextWorker++;
+  for (size_t i = 0; i < nWorkers; i++) {
+    size_t begin = tasks.size() * i / nWorkers;
+    size_t end = tasks.size() * (i + 1) / nWorkers;
+    if (begin == end) {
+      continue;
+    }
+    Worker& w = *workers[(first + i) % nWorkers];
+    {
+      std::lock_guard<std::mutex> lock(w.tasksLock);
+      for (size_t j = begin; j < end; j++) {
+        w.tasks.push_back([batch, task = std::move(tasks[j])]() {
+          try {
+            task();
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(batch->errorLock);
+            if (!batch->error) {
+              batch->error = std::current_exception();
+            }
+          }
+          if (--batch->remaining == 0) {
+            if (batch->error) {
+              batch->done.set_exception(batch->error);
+            } else {
+              batch->done.set_value();
+            }
+          }
+        });
+      }
+    }
+    w.thread->wake();
+  }
+  return result;
+}
+
+int ThreadPool::parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t grainSize)
+{
+  if (isStopped()) {
+    return -1;
+  }
+  if (end <= begin) {
+    return 0;
+  }
+  if (grainSize == 0) {
+    grainSize = std::max((size_t)1, (end - begin) / (4 * workers.size()));
+  }
+  // exceptions thrown by body are kept here, so that the batch only fails when the pool is stopped
+  std::mutex errorLock;
+  std::exception_ptr error;
+  std::vector<std::function<void()>> tasks;
+  for (size_t i = begin; i < end; i += grainSize) {
+    size_t partEnd = std::min(end, i + grainSize);
+    tasks.push_back([&body, &errorLock, &error, i, partEnd]() {
+      try {
+        body(i, partEnd);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorLock);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    });
+  }
+  std::future<void> done = submitBatch(std::move(tasks));
+
+  // help while waiting
+  int self = getCurrentWorker();
+  while (done.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    if (!runTask(self)) {
+      std::this_thread::yield();
+    }
+  }
+  bool isRejected = false;
+  try {
+    done.get();
+  } catch (const std::runtime_error&) {
+    // pool stopped before the batch was queued
+    isRejected = true;
+  } catch (const std::future_error&) {
+    // pool stopped without draining: some parts were discarded
+    isRejected = true;
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return isRejected ? -1 : 0;
+}
+
+bool ThreadPool::runTask(int index)
+{
+  Task task;
+  int nWorkers = (int)workers.size();
+  if (index >= 0) {
+    // own queue: most recent first
+    Worker& w = *workers[index];
+    std::lock_guard<std::mutex> lock(w.tasksLock);
+    if (!w.tasks.empty()) {
+      task = std::move(w.tasks.back());
+      w.tasks.pop_back();
+    }
+  }
+  if (!task) {
+    // steal oldest task of another queue, without waiting on busy locks
+    for (int i = 1; (i <= nWorkers) && (!task); i++) {
+      Worker& w = *workers[(index + i + nWorkers) % nWorkers];
+      std::unique_lock<std::mutex> lock(w.tasksLock, std::try_to_lock);
+      if (lock.owns_lock() && !w.tasks.empty()) {
+        task = std::move(w.tasks.front());
+        w.tasks.pop_front();
+      }
+    }
+  }
+  if (!task) {
+    return false;
+  }
+  task();
+  removePending(1);
+  return true;
+}
+
+int ThreadPool::addPending(size_t n)
+{
+  // counted before checking stop: either stop() waits for these tasks, or they are rejected here
+  nPending += n;
+  if (isStopped()) {
+    removePending(n);
+    return -1;
+  }
+  return 0;
+}
+
+void ThreadPool::removePending(size_t n)
+{
+  if (nPending.fetch_sub(n) == n) {
+    std::lock_guard<std::mutex> lock(idleLock);
+    idleCondition.notify_all();
+  }
+}
+
+Thread::CallbackResult ThreadPool::workerLoop(void* arg)
+{
+  Worker* w = (Worker*)arg;
+  ThreadPool* pool = w->pool;
+  threadPoolCurrent = pool;
+  threadPoolCurrentWorker = w->index;
+  if (pool->runTask(w->index)) {
+    return Thread::CallbackResult::Ok;
+  }
+  return Thread::CallbackResult::Idle;
+}
+
+void ThreadPool::waitIdle()
+{
+  int self = getCurrentWorker();
+  if (self >= 0) {
+    // called from a task: help, as this one will never be done while waiting.
+    // Tasks waiting here are not waited for, otherwise concurrent callers would wait for each other.
+    nWaiting++;
+    while (nPending > nWaiting) {
+      if (!runTask(self)) {
+        std::this_thread::yield();
+      }
+    }
+    nWaiting--;
+    return;
+  }
+  std::unique_lock<std::mutex> lock(idleLock);
+  idleCondition.wait(lock, [this]() { return nPending == 0; });
+}
+
+void ThreadPool::stop(bool drain)
+{
+  isStopping = true;
+  if (!drain) {
+    // discard pending tasks
+    for (auto& w : workers) {
+      std::deque<Task> discarded;
+      {
+        std::lock_guard<std::mutex> lock(w->tasksLock);
+        discarded.swap(w->tasks);
+      }
+      removePending(discarded.size());
+    }
+  }
+  waitIdle();
+  for (auto& w : workers) {
+    w->thread->stop();
+  }
+  for (auto& w : workers) {
+    w->thread->join();
+  }
+}
+
+void ThreadPool::setStopFlag(const std::atomic<bool>* flag)
+{
+  stopFlag = flag;
+}
+
+bool ThreadPool::isStopped() const
+{
+  return isStopping || ((stopFlag != nullptr) && (stopFlag->load(std::memory_order_relaxed)));
+}
+
+int ThreadPool::getNumberOfWorkers() const
+{
+  return (int)workers.size();
+}
+
+int ThreadPool::getWorkerStats(int index, Thread::Stats& stats) const
+{
+  if ((index < 0) || (index >= (int)workers.size())) {
+    return -1;
+  }
+  stats = workers[index]->thread->getStats();
+  return 0;
+}
+
+} // namespace Common
+} // namespace AliceO2
@@ -0,0 +1,166 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+// benchmark of LineBuffer
+// measures the speed of line splitting for each implementation of the search for ends of lines, with short and long lines,
+// and the speed of reading lines from a file (from page cache) for each file access method.
+// usage: benchLineBuffer [megabytesPerRun]
+
+#include <Common/LineBuffer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct BenchMethod {
+  const char* name;
+  LineBuffer::ScanMethod method;
+};
+
+static const BenchMethod methods[] = {
+  { "memchr", LineBuffer::ScanMethod::ScanMemchr },
+  { "sse2", LineBuffer::ScanMethod::ScanSSE2 },
+  { "avx2", LineBuffer::ScanMethod::ScanAVX2 },
+  { "auto", LineBuffer::ScanMethod::ScanAuto }
+};
+
+static const size_t lineLengths[] = { 8, 32, 100, 1000, 10000 }; // average line lengths tested, in bytes
+
+// read all lines of a file, with given method, and return number of lines
+// \param path           File path.
+// \param method         "fd" for LineBuffer::appendFromFileDescriptor(), otherwise "mapped", "chunks", or "parallel-N" with N threads.
+static size_t readFile(const std::string& path, const std::string& method)
+{
+  size_t nLines = 0;
+  std::vector<std::string_view> lines;
+  if (method == "fd") {
+    LineBuffer lb;
+    int fd = open(path.c_str(), O_RDONLY);
+    for (;;) {
+      bool isEof = lb.appendFromFileDescriptor(fd, -1) != 0;
+      lines.clear();
+      nLines += lb.getLines(lines);
+      if (isEof) {
+        break;
+      }
+    }
+    close(fd);
+  } else if (method.compare(0, 9, "parallel-") == 0) {
+    std::vector<LineFileReader::FilePart> parts;
+    LineFileReader::splitFile(path.c_str(), atoi(method.c_str() + 9), parts);
+    std::vector<size_t> counts(parts.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < parts.size(); i++) {
+      threads.push_back(std::thread([&path, &parts, &counts, i]() {
+        LineFileReader reader;
+        std::vector<std::string_view> lines;
+        reader.open(path.c_str(), LineFileReader::ReadAuto, &parts[i]);
+        while (reader.getLines(lines) > 0) {
+          counts[i] += lines.size();
+          lines.clear();
+        }
+      }));
+    }
+    for (size_t i = 0; i < parts.size(); i++) {
+      threads[i].join();
+      nLines += counts[i];
+    }
+  } else {
+    LineFileReader reader;
+    reader.open(path.c_str(), (method == "mapped") ? LineFileReader::ReadMapped : LineFileReader::ReadChunks);
+    while (reader.getLines(lines) > 0) {
+      nLines += lines.size();
+      lines.clear();
+    }
+  }
+  return nLines;
+}
+
+int main(int argc, char** argv)
+{
+  size_t totalSize = 1024 * 1024 * 1024;
+  if (argc > 1) {
+    totalSize = strtoul(argv[1], NULL, 10) * 1024 * 1024;
+  }
+  const size_t chunkSize = 1024 * 1024; // size of data added to buffer at once
+
+  printf("%-8s %8s %10s %10s\n", "method", "line", "GB/s", "ns/line");
+  for (size_t lineLength : lineLengths) {
+    // lines of variable length around average, so that ends of lines fall at all positions
+    std::string chunk;
+    srand(1);
+    while (chunk.size() < chunkSize) {
+      size_t len = lineLength / 2 + rand() % (lineLength + 1);
+      chunk.append(len, 'x');
+      chunk.push_back('\n');
+    }
+
+    for (const auto& m : methods) {
+      if (LineBuffer::setScanMethod(m.method) != 0) {
+        printf("%-8s %8zu %10s %10s\n", m.name, lineLength, "n/a", "n/a");
+        continue;
+      }
+      LineBuffer lb(2 * chunkSize);
+      std::vector<std::string_view> lines;
+      size_t nLines = 0;
+      size_t nBytes = 0;
+      auto t0 = std::chrono::steady_clock::now();
+      while (nBytes < totalSize) {
+        lb.appendData(chunk.data(), chunk.size());
+        lines.clear();
+        nLines += lb.getLines(lines);
+        nBytes += chunk.size();
+      }
+      double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      printf("%-8s %8zu %10.2f %10.2f\n", m.name, lineLength, nBytes / elapsed / 1E9, elapsed * 1E9 / nLines);
+    }
+  }
+  LineBuffer::setScanMethod(LineBuffer::ScanMethod::ScanAuto);
+
+  // file of lines of 100 bytes average, read a first time to be in page cache
+  char path[] = "/tmp/benchLineBuffer.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return -1;
+  }
+  std::string chunk;
+  srand(1);
+  while (chunk.size() < chunkSize) {
+    chunk.append(50 + rand() % 101, 'x');
+    chunk.push_back('\n');
+  }
+  size_t fileSize = 0;
+  while (fileSize < totalSize) {
+    if (write(fd, chunk.data(), chunk.size()) != (ssize_t)chunk.size()) {
+      perror("write");
+      break;
+    }
+    fileSize += chunk.size();
+  }
+  close(fd);
+  readFile(path, "chunks");
+
+  printf("\n%-12s %10s %10s\n", "file", "GB/s", "ns/line");
+  for (std::string method : { "fd", "chunks", "mapped", "parallel-2", "parallel-4", "parallel-8" }) {
+    auto t0 = std::chrono::steady_clock::now();
+    size_t nLines = readFile(path, method);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("%-12s %10.2f %10.2f\n", method.c_str(), fileSize / elapsed / 1E9, elapsed * 1E9 / nLines);
+  }
+  unlink(path);
+  return 0;
+}
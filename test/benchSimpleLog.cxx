@@ -0,0 +1,144 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+// benchmark of SimpleLog
+// measures the cost of logging a message, for each format option, output type (file, with or without rotation, stdout, /dev/null),
+// and number of logging threads.
+// usage: benchSimpleLog [messagesPerThread] [maxThreads]
+// Results are printed on stderr, as stdout is one of the outputs tested: run it with stdout redirected (e.g. > /dev/null).
+
+#include <Common/SimpleLog.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// output tested
+enum BenchOutput { OutputFile,
+                   OutputFileRotate,
+                   OutputStdout,
+                   OutputDevNull };
+
+static const char* outputNames[] = { "file", "file+rotate", "stdout", "/dev/null" };
+
+// format options tested
+struct BenchFormat {
+  const char* name;
+  int options;
+};
+
+static const BenchFormat formats[] = {
+  { "message", SimpleLog::FormatOption::ShowMessage },
+  { "default", SimpleLog::FormatOption::ShowTimeStamp | SimpleLog::FormatOption::ShowSeveritySymbol | SimpleLog::FormatOption::ShowMessage },
+  { "coarse", SimpleLog::FormatOption::ShowTimeStamp | SimpleLog::FormatOption::ShowSeveritySymbol | SimpleLog::FormatOption::ShowMessage | SimpleLog::FormatOption::CoarseTimeStamp },
+  { "severity-txt", SimpleLog::FormatOption::ShowTimeStamp | SimpleLog::FormatOption::ShowSeverityTxt | SimpleLog::FormatOption::ShowMessage },
+  { "json", SimpleLog::FormatOption::OutputJSON },
+  { "logfmt", SimpleLog::FormatOption::OutputLogfmt }
+};
+
+static const unsigned long rotateMaxBytes = 16 * 1024 * 1024; // file size when rotation enabled
+static const unsigned int rotateMaxFiles = 3;                  // number of files kept when rotation enabled
+
+// run a benchmark configuration, and print results
+// \param path           Log file path, for file outputs.
+// \param output         Output type.
+// \param format         Format options.
+// \param nThreads       Number of logging threads.
+// \param nMessages      Number of messages logged by each thread.
+static void runBench(const std::string& path, BenchOutput output, const BenchFormat& format, int nThreads, unsigned long nMessages)
+{
+  int fdNull = -1;
+  double elapsed;
+  SimpleLog::Stats stats;
+  {
+    SimpleLog theLog;
+    if (output == OutputFile) {
+      theLog.setLogFile(path.c_str());
+    } else if (output == OutputFileRotate) {
+      theLog.setLogFile(path.c_str(), rotateMaxBytes, rotateMaxFiles);
+    } else if (output == OutputDevNull) {
+      // not using setLogFile("/dev/null"), which discards messages before formatting
+      fdNull = open("/dev/null", O_WRONLY);
+      theLog.setFileDescriptors(fdNull, fdNull);
+    }
+    theLog.setOutputFormat(format.options);
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+      threads.push_back(std::thread([&theLog, i, nMessages]() {
+        for (unsigned long j = 0; j < nMessages; j++) {
+          theLog.info("thread %d message %lu: some text with a value %.3f", i, j, j * 0.001);
+        }
+      }));
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    theLog.flush();
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    stats = theLog.getStats();
+  }
+  if (fdNull >= 0) {
+    close(fdNull);
+  }
+
+  unsigned long nTotal = nMessages * nThreads;
+  unsigned long nWritten = stats.messages[SimpleLog::Severity::Info];
+  fprintf(stderr, "%-12s %-13s %7d %10.1f %12.0f %9.1f %8lu\n", outputNames[output], format.name, nThreads,
+          elapsed * 1E9 * nThreads / nTotal, nTotal / elapsed,
+          nWritten ? (double)stats.bytes[SimpleLog::Severity::Info] / nWritten : 0.0, nTotal - nWritten);
+
+  // cleanup
+  unlink(path.c_str());
+  for (unsigned int i = 1; i < rotateMaxFiles; i++) {
+    unlink((path + "." + std::to_string(i)).c_str());
+  }
+}
+
+int main(int argc, char** argv)
+{
+  unsigned long nMessages = 100000;
+  int maxThreads = 8;
+  if (argc > 1) {
+    nMessages = strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    maxThreads = atoi(argv[2]);
+  }
+  if (isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "stdout is a terminal, results for stdout output will include terminal rendering. Redirect stdout to a file or /dev/null.\n");
+  }
+
+  char tmpName[] = "/tmp/benchSimpleLog.XXXXXX";
+  int fd = mkstemp(tmpName);
+  if (fd < 0) {
+    perror("mkstemp");
+    return -1;
+  }
+  close(fd);
+  std::string path = tmpName;
+
+  // ns/msg is the average time spent by a thread to log a message, msg/s the total throughput of all threads
+  fprintf(stderr, "%-12s %-13s %7s %10s %12s %9s %8s\n", "output", "format", "threads", "ns/msg", "msg/s", "bytes/msg", "failed");
+  for (int output = OutputFile; output <= OutputDevNull; output++) {
+    for (const auto& format : formats) {
+      for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        runBench(path, (BenchOutput)output, format, nThreads, nMessages);
+      }
+    }
+  }
+  return 0;
+}
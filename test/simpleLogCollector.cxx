@@ -0,0 +1,87 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+// simple local log collector, standing in for syslog/journald to test SimpleLog socket output
+// it receives messages on a Unix-domain datagram socket, and prints them one per line
+// usage: simpleLogCollector socketPath [outputFile]
+
+#include <Common/signalUtilities.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s socketPath [outputFile]\n", argv[0]);
+    return 1;
+  }
+  const char* socketPath = argv[1];
+  FILE* fp = stdout;
+  if (argc > 2) {
+    fp = fopen(argv[2], "a");
+    if (fp == NULL) {
+      fprintf(stderr, "Failed to open %s: %s\n", argv[2], strerror(errno));
+      return 1;
+    }
+  }
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path too long\n");
+    return 1;
+  }
+  strcpy(address.sun_path, socketPath);
+  int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+    return 1;
+  }
+  unlink(socketPath);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    fprintf(stderr, "Failed to bind socket %s: %s\n", socketPath, strerror(errno));
+    return 1;
+  }
+
+  signal(SIGINT, handler_interruption);
+  signal(SIGTERM, handler_interruption);
+
+  unsigned long nMessages = 0;
+  static char buffer[256 * 1024];
+  while (keepRunning) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 100) <= 0) {
+      continue;
+    }
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+      continue;
+    }
+    fwrite(buffer, 1, n, fp);
+    fputc('\n', fp);
+    fflush(fp);
+    nMessages++;
+  }
+
+  close(fd);
+  unlink(socketPath);
+  fprintf(stderr, "%lu messages received\n", nMessages);
+  if (fp != stdout) {
+    fclose(fp);
+  }
+  return 0;
+}
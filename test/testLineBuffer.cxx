@@ -0,0 +1,489 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include <Common/LineBuffer.h>
+
+#define BOOST_TEST_MODULE LineBuffer test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(linebuffer_test)
+{
+  LineBuffer lb;
+  std::string line;
+  lb.appendData("first\nsec", 9);
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), 0);
+  BOOST_CHECK_EQUAL(line, "first");
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), -1);
+  lb.appendData("ond\n\nlast", 9);
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), 0);
+  BOOST_CHECK_EQUAL(line, "second");
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), 0);
+  BOOST_CHECK_EQUAL(line, "");
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), -1);
+  lb.flush();
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), 0);
+  BOOST_CHECK_EQUAL(line, "last");
+}
+
+BOOST_AUTO_TEST_CASE(linebuffer_view_test)
+{
+  // small buffer, to check growth
+  LineBuffer lb(16);
+  std::string longLine(1000, 'x');
+  lb.appendData(longLine.c_str(), longLine.size());
+  lb.appendData("\nbinary\0data\nshort\nlast", 23);
+
+  std::vector<std::string_view> lines;
+  BOOST_CHECK_EQUAL(lb.getLines(lines), 3);
+  BOOST_REQUIRE_EQUAL(lines.size(), 3);
+  BOOST_CHECK(lines[0] == longLine);
+  BOOST_CHECK(lines[1] == std::string_view("binary\0data", 11));
+  BOOST_CHECK(lines[2] == "short");
+
+  std::string_view line;
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), -1);
+  lb.appendData(" line\n", 6);
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), 0);
+  BOOST_CHECK(line == "last line");
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), -1);
+}
+
+BOOST_AUTO_TEST_CASE(linebuffer_scan_test)
+{
+  // random binary content, with ends of lines at all positions relative to blocks
+  std::string data;
+  srand(1);
+  for (int i = 0; i < 100000; i++) {
+    data.push_back((rand() % 8 == 0) ? '\n' : (char)(rand() % 256));
+  }
+  std::vector<std::string> expected;
+  size_t begin = 0;
+  for (size_t i = 0; i < data.size(); i++) {
+    if (data[i] == '\n') {
+      expected.push_back(data.substr(begin, i - begin));
+      begin = i + 1;
+    }
+  }
+
+  for (auto method : { LineBuffer::ScanMemchr, LineBuffer::ScanSSE2, LineBuffer::ScanAVX2, LineBuffer::ScanAuto }) {
+    if (LineBuffer::setScanMethod(method) != 0) {
+      continue;
+    }
+    // one by one, and in batches, with data added in chunks of various sizes
+    for (int batch = 0; batch < 2; batch++) {
+      LineBuffer lb(1000);
+      std::vector<std::string> lines;
+      for (size_t i = 0; i < data.size();) {
+        size_t n = std::min((size_t)(1 + rand() % 3000), data.size() - i);
+        lb.appendData(&data[i], n);
+        i += n;
+        if (batch) {
+          std::vector<std::string_view> views;
+          lb.getLines(views);
+          for (auto& v : views) {
+            lines.push_back(std::string(v));
+          }
+        } else {
+          std::string_view v;
+          while (lb.getNextLine(v) == 0) {
+            lines.push_back(std::string(v));
+          }
+        }
+      }
+      BOOST_CHECK(lines == expected);
+    }
+  }
+  LineBuffer::setScanMethod(LineBuffer::ScanAuto);
+}
+
+BOOST_AUTO_TEST_CASE(linebuffer_fd_test)
+{
+  // use a file descriptor above FD_SETSIZE, if allowed
+  struct rlimit rl;
+  BOOST_REQUIRE(getrlimit(RLIMIT_NOFILE, &rl) == 0);
+  int highFd = FD_SETSIZE + 10;
+  if (rl.rlim_cur <= (rlim_t)highFd) {
+    rl.rlim_cur = (rl.rlim_max > (rlim_t)highFd) ? (rlim_t)highFd + 1 : rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  int fds[2];
+  BOOST_REQUIRE(pipe(fds) == 0);
+  if (dup2(fds[0], highFd) == highFd) {
+    close(fds[0]);
+    fds[0] = highFd;
+  }
+
+  LineBuffer lb;
+  std::string line;
+  BOOST_CHECK_EQUAL(write(fds[1], "hello\nworld\n", 12), 12);
+  BOOST_CHECK_EQUAL(lb.appendFromFileDescriptor(fds[0], 100), 0);
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), 0);
+  BOOST_CHECK_EQUAL(line, "hello");
+  BOOST_CHECK_EQUAL(lb.getNextLine(line), 0);
+  BOOST_CHECK_EQUAL(line, "world");
+  close(fds[1]);
+  BOOST_CHECK_EQUAL(lb.appendFromFileDescriptor(fds[0], 100), -1);
+  close(fds[0]);
+}
+
+BOOST_AUTO_TEST_CASE(linebuffer_multiplexer_test)
+{
+  const int nPipes = 50;
+  std::vector<int> readFds;
+  std::vector<int> writeFds;
+  LineBufferMultiplexer mux;
+  for (int i = 0; i < nPipes; i++) {
+    int fds[2];
+    BOOST_REQUIRE(pipe(fds) == 0);
+    readFds.push_back(fds[0]);
+    writeFds.push_back(fds[1]);
+    BOOST_CHECK_EQUAL(mux.addFileDescriptor(fds[0]), 0);
+  }
+  BOOST_CHECK_EQUAL(mux.addFileDescriptor(readFds[0]), -1);
+  BOOST_CHECK_EQUAL(mux.getNumberOfFileDescriptors(), nPipes);
+
+  // nothing to read
+  BOOST_CHECK_EQUAL(mux.appendFromFileDescriptors(0), 0);
+
+  // write to some of the pipes, last line without end of line
+  std::map<int, std::vector<std::string>> expected;
+  for (int i = 0; i < nPipes; i += 5) {
+    std::string s = "line 1 of " + std::to_string(i) + "\nline 2 of " + std::to_string(i) + "\nend of " + std::to_string(i);
+    BOOST_CHECK_EQUAL(write(writeFds[i], s.c_str(), s.length()), (ssize_t)s.length());
+    close(writeFds[i]);
+    writeFds[i] = -1;
+    expected[readFds[i]] = { "line 1 of " + std::to_string(i), "line 2 of " + std::to_string(i), "end of " + std::to_string(i) };
+  }
+
+  std::map<int, std::vector<std::string>> received;
+  std::vector<int> closed;
+  for (int i = 0; (i < 100) && (closed.size() < expected.size()); i++) {
+    BOOST_CHECK_GE(mux.appendFromFileDescriptors(100), 0);
+    int fd;
+    std::string line;
+    while (mux.getNextLine(fd, line) == 0) {
+      received[fd].push_back(line);
+    }
+    while (mux.getNextClosed(fd) == 0) {
+      closed.push_back(fd);
+      close(fd);
+    }
+  }
+  BOOST_CHECK(received == expected);
+  BOOST_CHECK_EQUAL(closed.size(), expected.size());
+  BOOST_CHECK_EQUAL(mux.getNumberOfFileDescriptors(), nPipes - expected.size());
+
+  for (int i = 0; i < nPipes; i++) {
+    if (writeFds[i] >= 0) {
+      BOOST_CHECK_EQUAL(mux.removeFileDescriptor(readFds[i]), 0);
+      close(readFds[i]);
+      close(writeFds[i]);
+    }
+  }
+  BOOST_CHECK_EQUAL(mux.getNumberOfFileDescriptors(), 0);
+
+  // remove a file descriptor with pending lines: last line returned still valid, pending ones discarded
+  int fds[2];
+  BOOST_REQUIRE(pipe(fds) == 0);
+  BOOST_CHECK_EQUAL(mux.addFileDescriptor(fds[0]), 0);
+  BOOST_CHECK_EQUAL(write(fds[1], "a1\na2\n", 6), 6);
+  BOOST_CHECK_EQUAL(mux.appendFromFileDescriptors(100), 1);
+  int fd;
+  std::string_view view;
+  BOOST_CHECK_EQUAL(mux.getNextLine(fd, view), 0);
+  BOOST_CHECK_EQUAL(mux.removeFileDescriptor(fds[0]), 0);
+  BOOST_CHECK_EQUAL(view, "a1");
+  close(fds[0]);
+  close(fds[1]);
+
+  // file descriptor number reused by a new source
+  int reusedFds[2];
+  BOOST_REQUIRE(pipe(reusedFds) == 0);
+  BOOST_CHECK_EQUAL(mux.addFileDescriptor(reusedFds[0]), 0);
+  BOOST_CHECK_EQUAL(write(reusedFds[1], "b1\n", 3), 3);
+  BOOST_CHECK_EQUAL(mux.appendFromFileDescriptors(100), 1);
+  std::vector<std::string> lines;
+  while (mux.getNextLine(fd, view) == 0) {
+    lines.push_back(std::string(view));
+  }
+  BOOST_CHECK(lines == std::vector<std::string>({ "b1" }));
+  BOOST_CHECK_EQUAL(mux.removeFileDescriptor(reusedFds[0]), 0);
+  close(reusedFds[0]);
+  close(reusedFds[1]);
+}
+
+BOOST_AUTO_TEST_CASE(linebuffer_limits_test)
+{
+  std::string_view line;
+  std::vector<std::string_view> lines;
+
+  // split long lines, complete or not
+  LineBuffer lbSplit;
+  BOOST_CHECK_EQUAL(lbSplit.setMaxLineLength(4, LineBuffer::OverflowBlock), -1);
+  BOOST_CHECK_EQUAL(lbSplit.setMaxLineLength(4, LineBuffer::OverflowSplit), 0);
+  lbSplit.appendData("abcdefghij\nxy\n1234", 18);
+  lbSplit.appendData("5678", 4);
+  lbSplit.appendData("9\n", 2);
+  lbSplit.getLines(lines);
+  BOOST_CHECK((lines == std::vector<std::string_view>{ "abcd", "efgh", "ij", "xy", "1234", "5678", "9" }));
+  BOOST_CHECK_EQUAL(lbSplit.getStats().splitLines, 4);
+
+  // drop long lines, complete or not
+  LineBuffer lbDrop;
+  BOOST_CHECK_EQUAL(lbDrop.setMaxLineLength(4, LineBuffer::OverflowDrop), 0);
+  lbDrop.appendData("abcdefghij\nxy\n1234", 18);
+  lbDrop.appendData("5678", 4);
+  lbDrop.appendData("9\nok\nlonglast", 13);
+  lbDrop.flush();
+  lines.clear();
+  lbDrop.getLines(lines);
+  BOOST_CHECK((lines == std::vector<std::string_view>{ "xy", "ok" }));
+  BOOST_CHECK_EQUAL(lbDrop.getStats().droppedLines, 3);
+  BOOST_CHECK_EQUAL(lbDrop.getStats().splitLines, 0);
+
+  // drop lines when too many buffered (including the incomplete one)
+  LineBuffer lbFull;
+  BOOST_CHECK_EQUAL(lbFull.setMaxLines(2, LineBuffer::OverflowSplit), -1);
+  BOOST_CHECK_EQUAL(lbFull.setMaxLines(2, LineBuffer::OverflowDrop), 0);
+  lbFull.appendData("1\n2\n3\n4", 7);
+  BOOST_CHECK(!lbFull.isFull());
+  BOOST_CHECK_EQUAL(lbFull.getNextLine(line), 0);
+  BOOST_CHECK_EQUAL(line, "1");
+  lbFull.appendData("\n5\n", 3);
+  lines.clear();
+  lbFull.getLines(lines);
+  BOOST_CHECK((lines == std::vector<std::string_view>{ "2", "5" }));
+  BOOST_CHECK_EQUAL(lbFull.getStats().droppedLines, 2);
+
+  // stop reading pipe when too many buffered, until lines retrieved
+  int fds[2];
+  BOOST_REQUIRE(pipe(fds) == 0);
+  LineBuffer lbBlock;
+  BOOST_CHECK_EQUAL(lbBlock.setMaxLines(2), 0);
+  BOOST_CHECK_EQUAL(write(fds[1], "1\n2\n", 4), 4);
+  BOOST_CHECK_EQUAL(lbBlock.appendFromFileDescriptor(fds[0], 0), 0);
+  BOOST_CHECK(lbBlock.isFull());
+  BOOST_CHECK_EQUAL(write(fds[1], "3\n", 2), 2);
+  BOOST_CHECK_EQUAL(lbBlock.appendFromFileDescriptor(fds[0], 0), 0);
+  BOOST_CHECK_EQUAL(lbBlock.getStats().blockedReads, 2);
+  BOOST_CHECK_EQUAL(lbBlock.getNextLine(line), 0);
+  BOOST_CHECK(!lbBlock.isFull());
+  BOOST_CHECK_EQUAL(lbBlock.appendFromFileDescriptor(fds[0], 0), 0);
+  lines.clear();
+  lbBlock.getLines(lines);
+  BOOST_CHECK((lines == std::vector<std::string_view>{ "2", "3" }));
+
+  // same with multiplexer: full pipe is not polled until lines retrieved
+  LineBufferMultiplexer mux;
+  BOOST_CHECK_EQUAL(mux.setMaxLines(1), 0);
+  BOOST_CHECK_EQUAL(mux.addFileDescriptor(fds[0]), 0);
+  BOOST_CHECK_EQUAL(write(fds[1], "4\n5\n", 4), 4);
+  BOOST_CHECK_EQUAL(mux.appendFromFileDescriptors(100), 1);
+  BOOST_CHECK_EQUAL(mux.appendFromFileDescriptors(0), 0);
+  BOOST_CHECK_EQUAL(mux.getStats().blockedReads, 1);
+  int fd;
+  std::string s;
+  BOOST_CHECK_EQUAL(mux.getNextLine(fd, s), 0);
+  BOOST_CHECK_EQUAL(s, "4");
+  BOOST_CHECK_EQUAL(mux.getNextLine(fd, s), 0);
+  BOOST_CHECK_EQUAL(s, "5");
+  BOOST_CHECK_EQUAL(mux.getNextLine(fd, s), -1);
+  close(fds[1]);
+  BOOST_CHECK_EQUAL(mux.appendFromFileDescriptors(100), 1);
+  BOOST_CHECK_EQUAL(mux.getNextLine(fd, s), -1);
+  BOOST_CHECK_EQUAL(mux.getNextClosed(fd), 0);
+  BOOST_CHECK_EQUAL(mux.getStats().blockedReads, 1);
+  close(fds[0]);
+}
+
+BOOST_AUTO_TEST_CASE(linebuffer_framing_test)
+{
+  std::string_view record;
+  std::vector<std::string_view> records;
+
+  // custom delimiter
+  LineBuffer lbDelimiter;
+  BOOST_CHECK_EQUAL(lbDelimiter.setFramingDelimiter('\0'), 0);
+  lbDelimiter.appendData("a\nb\0c\0d", 7);
+  lbDelimiter.flush();
+  lbDelimiter.getLines(records);
+  BOOST_CHECK((records == std::vector<std::string_view>{ "a\nb", "c", "d" }));
+
+  // fixed size, data received in pieces
+  LineBuffer lbFixed;
+  BOOST_CHECK_EQUAL(lbFixed.setFramingFixedSize(0), -1);
+  BOOST_CHECK_EQUAL(lbFixed.setFramingFixedSize(3), 0);
+  BOOST_CHECK_EQUAL(lbFixed.setMaxLines(10), -1);
+  lbFixed.appendData("ab", 2);
+  BOOST_CHECK_EQUAL(lbFixed.getNextLine(record), -1);
+  lbFixed.appendData("\ncde\0f", 6);
+  records.clear();
+  BOOST_CHECK_EQUAL(lbFixed.getLines(records), 2);
+  BOOST_CHECK((records == std::vector<std::string_view>{ "ab\n", std::string_view("cde", 3) }));
+  lbFixed.appendData("g", 1);
+  BOOST_CHECK_EQUAL(lbFixed.getNextLine(record), 0);
+  BOOST_CHECK(record == std::string_view("\0fg", 3));
+
+  // length prefix, both byte orders
+  LineBuffer lbPrefix;
+  BOOST_CHECK_EQUAL(lbPrefix.setFramingLengthPrefix(3), -1);
+  BOOST_CHECK_EQUAL(lbPrefix.setFramingLengthPrefix(2), 0);
+  lbPrefix.appendData("\x00\x03xyz\x00\x00", 7);
+  records.clear();
+  BOOST_CHECK_EQUAL(lbPrefix.getLines(records), 2);
+  BOOST_CHECK((records == std::vector<std::string_view>{ "xyz", "" }));
+  lbPrefix.appendData("\x00", 1);
+  BOOST_CHECK_EQUAL(lbPrefix.getNextLine(record), -1);
+  lbPrefix.appendData("\x01t", 2);
+  BOOST_CHECK_EQUAL(lbPrefix.getNextLine(record), 0);
+  BOOST_CHECK_EQUAL(record, "t");
+  BOOST_CHECK_EQUAL(lbPrefix.setFramingLengthPrefix(4, false), 0);
+  lbPrefix.appendData("\x02\x00\x00\x00uv", 6);
+  BOOST_CHECK_EQUAL(lbPrefix.getNextLine(record), 0);
+  BOOST_CHECK_EQUAL(record, "uv");
+
+  // large length-prefixed records from a pipe, with the multiplexer
+  int fds[2];
+  BOOST_REQUIRE(pipe(fds) == 0);
+  LineBufferMultiplexer mux;
+  BOOST_CHECK_EQUAL(mux.setFramingLengthPrefix(4), 0);
+  BOOST_CHECK_EQUAL(mux.addFileDescriptor(fds[0]), 0);
+  bool isWriteOk = true; // Boost checks are not thread-safe, result checked after join
+  std::thread writer([&fds, &isWriteOk]() {
+    for (uint32_t size = 1; (size <= 1000000) && isWriteOk; size *= 10) {
+      unsigned char prefix[4] = { (unsigned char)(size >> 24), (unsigned char)(size >> 16), (unsigned char)(size >> 8), (unsigned char)size };
+      std::string data(size, (char)('0' + size % 7));
+      isWriteOk = (write(fds[1], prefix, 4) == 4);
+      for (size_t done = 0; (done < data.size()) && isWriteOk;) {
+        ssize_t n = write(fds[1], data.data() + done, data.size() - done);
+        isWriteOk = (n > 0);
+        done += (n > 0) ? n : 0;
+      }
+    }
+    close(fds[1]);
+  });
+  std::vector<std::string> received;
+  bool isClosed = false;
+  for (int i = 0; (i < 1000) && (!isClosed); i++) {
+    BOOST_CHECK_GE(mux.appendFromFileDescriptors(100), 0);
+    int fd;
+    while (mux.getNextLine(fd, record) == 0) {
+      received.push_back(std::string(record));
+    }
+    isClosed = (mux.getNextClosed(fd) == 0);
+  }
+  writer.join();
+  BOOST_CHECK(isWriteOk);
+  BOOST_CHECK(isClosed);
+  BOOST_REQUIRE_EQUAL(received.size(), 7);
+  for (uint32_t size = 1, i = 0; size <= 1000000; size *= 10, i++) {
+    BOOST_CHECK(received[i] == std::string(size, (char)('0' + size % 7)));
+  }
+  close(fds[0]);
+}
+
+BOOST_AUTO_TEST_CASE(linebuffer_file_test)
+{
+  // file with lines of various lengths, last one without end of line
+  char path[] = "/tmp/testLineBuffer.XXXXXX";
+  int fd = mkstemp(path);
+  BOOST_REQUIRE(fd >= 0);
+  std::vector<std::string> expected;
+  std::string content;
+  srand(1);
+  for (int i = 0; i < 20000; i++) {
+    std::string line = std::to_string(i) + std::string(rand() % ((i % 100 == 0) ? 100000 : 100), 'x');
+    if (i % 1000 == 0) {
+      line.clear();
+    }
+    expected.push_back(line);
+    content += line;
+    if (i != 19999) {
+      content += "\n";
+    }
+  }
+  BOOST_REQUIRE_EQUAL(write(fd, content.data(), content.size()), (ssize_t)content.size());
+  close(fd);
+
+  for (auto mode : { LineFileReader::ReadAuto, LineFileReader::ReadMapped, LineFileReader::ReadChunks }) {
+    LineFileReader reader;
+    BOOST_CHECK_EQUAL(reader.open(path, mode), 0);
+    std::vector<std::string> received;
+    std::string line;
+    while (reader.getNextLine(line) == 0) {
+      received.push_back(line);
+    }
+    BOOST_CHECK(received == expected);
+
+    BOOST_CHECK_EQUAL(reader.open(path, mode), 0);
+    std::vector<std::string_view> views;
+    received.clear();
+    while (reader.getLines(views) > 0) {
+      for (auto v : views) {
+        received.push_back(std::string(v));
+      }
+      views.clear();
+    }
+    BOOST_CHECK(received == expected);
+  }
+
+  // parallel processing of parts of the file
+  for (size_t nParts : { 1, 3, 16 }) {
+    std::vector<LineFileReader::FilePart> parts;
+    BOOST_CHECK_EQUAL(LineFileReader::splitFile(path, nParts, parts), 0);
+    BOOST_CHECK_EQUAL(parts.size(), nParts);
+    std::vector<std::vector<std::string>> received(parts.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < parts.size(); i++) {
+      threads.push_back(std::thread([&, i]() {
+        LineFileReader reader;
+        if (reader.open(path, (i % 2) ? LineFileReader::ReadChunks : LineFileReader::ReadMapped, &parts[i]) == 0) {
+          std::string line;
+          while (reader.getNextLine(line) == 0) {
+            received[i].push_back(line);
+          }
+        }
+      }));
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    std::vector<std::string> all;
+    off_t offset = 0;
+    for (size_t i = 0; i < parts.size(); i++) {
+      BOOST_CHECK_EQUAL(parts[i].offset, offset);
+      offset += parts[i].size;
+      all.insert(all.end(), received[i].begin(), received[i].end());
+    }
+    BOOST_CHECK_EQUAL(offset, (off_t)content.size());
+    BOOST_CHECK(all == expected);
+  }
+
+  LineFileReader reader;
+  BOOST_CHECK_EQUAL(reader.open("/nonexistent/file"), -1);
+  std::string line;
+  BOOST_CHECK_EQUAL(reader.getNextLine(line), -1);
+  unlink(path);
+}
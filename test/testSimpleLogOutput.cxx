@@ -0,0 +1,568 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include <Common/SimpleLog.h>
+
+#define BOOST_TEST_MODULE SimpleLog output test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+// temporary log file, removed on exit
+class TmpLogFile
+{
+ public:
+  TmpLogFile()
+  {
+    char tmpName[] = "/tmp/testSimpleLogOutput.XXXXXX";
+    int fd = mkstemp(tmpName);
+    BOOST_REQUIRE(fd >= 0);
+    close(fd);
+    path = tmpName;
+  }
+
+  ~TmpLogFile()
+  {
+    unlink(path.c_str());
+  }
+
+  // get content of log file, line by line
+  std::vector<std::string> getLines()
+  {
+    std::vector<std::string> lines;
+    std::ifstream f(path);
+    std::string line;
+    while (std::getline(f, line)) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  std::string path;
+};
+
+static int nCalls = 0;
+
+// function with a side effect, to check if arguments are evaluated
+static int countCalls()
+{
+  return ++nCalls;
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_levels_test)
+{
+  TmpLogFile logFile;
+  {
+    SimpleLog theLog(logFile.path.c_str());
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowSeverityTxt | SimpleLog::FormatOption::ShowMessage);
+
+    // default level is info
+    BOOST_CHECK(!theLog.isEnabled(SimpleLog::Severity::Debug));
+    BOOST_CHECK(theLog.isEnabled(SimpleLog::Severity::Info));
+    theLog.trace("trace %d", 1);
+    theLog.debug("debug %d", 1);
+    theLog.info("info %d", 1);
+    SIMPLELOG_DEBUG(theLog, "debug %d", countCalls());
+    BOOST_CHECK_EQUAL(nCalls, 0);
+
+    theLog.setLogLevel(SimpleLog::Severity::Debug);
+    theLog.trace("trace %d", 2);
+    theLog.debug("debug %d", 2);
+    SIMPLELOG_DEBUG(theLog, "debug %d", countCalls());
+    BOOST_CHECK_EQUAL(nCalls, 1);
+
+    theLog.setLogLevel(SimpleLog::Severity::Error);
+    theLog.warning("warning %d", 3);
+    theLog.error("error %d", 3);
+    SIMPLELOG_WARNING(theLog, "warning %d", countCalls());
+    BOOST_CHECK_EQUAL(nCalls, 1);
+  }
+
+  std::vector<std::string> expected = { "info 1", "Debug - debug 2", "Debug - debug 1", "Error - error 3" };
+  std::vector<std::string> lines = logFile.getLines();
+  BOOST_CHECK_EQUAL_COLLECTIONS(lines.begin(), lines.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_ratelimit_test)
+{
+  TmpLogFile logFile;
+  {
+    SimpleLog theLog(logFile.path.c_str());
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+
+    // burst accepted, then limited to 1 message per second for this call site
+    theLog.setRateLimit(1, 5);
+    for (int i = 0; i < 100; i++) {
+      theLog.info("message %d", i);
+    }
+    theLog.info("other call site");
+    theLog.flush();
+  }
+
+  std::vector<std::string> lines = logFile.getLines();
+  BOOST_REQUIRE_GE(lines.size(), 8);
+  int nMessages = 0;
+  int nSuppressed = 0;
+  for (const auto& l : lines) {
+    int n;
+    if (sscanf(l.c_str(), "%d messages suppressed (rate limit): message %%d", &n) == 1) {
+      nSuppressed += n;
+    } else if (l.compare(0, 8, "message ") == 0) {
+      nMessages++;
+    }
+  }
+  BOOST_CHECK_GE(nMessages, 6);
+  BOOST_CHECK_EQUAL(nMessages + nSuppressed, 100);
+  BOOST_CHECK(std::find(lines.begin(), lines.end(), "other call site") != lines.end());
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_duplicates_test)
+{
+  TmpLogFile logFile;
+  {
+    SimpleLog theLog(logFile.path.c_str());
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+    theLog.setDuplicatesSuppression(true);
+    for (int i = 0; i < 10; i++) {
+      theLog.info("same message");
+    }
+    theLog.info("different message");
+    theLog.info("different message");
+  }
+
+  std::vector<std::string> expected = { "same message", "last message repeated 9 times", "different message", "last message repeated 1 times" };
+  std::vector<std::string> lines = logFile.getLines();
+  BOOST_CHECK_EQUAL_COLLECTIONS(lines.begin(), lines.end(), expected.begin(), expected.end());
+
+  // concurrent threads: each message is either written or counted in a repeat report
+  TmpLogFile concurrentLogFile;
+  const int nThreads = 4;
+  const int nMessages = 10000;
+  {
+    SimpleLog theLog(concurrentLogFile.path.c_str());
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+    theLog.setDuplicatesSuppression(true);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+      threads.emplace_back([&theLog, i]() {
+        for (int j = 0; j < nMessages; j++) {
+          theLog.info("message %d", (i + j / 100) % 2);
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  unsigned long nTotal = 0;
+  for (const auto& line : concurrentLogFile.getLines()) {
+    unsigned long n = 0;
+    if (sscanf(line.c_str(), "last message repeated %lu times", &n) == 1) {
+      nTotal += n;
+    } else {
+      nTotal++;
+    }
+  }
+  BOOST_CHECK_EQUAL(nTotal, nThreads * nMessages);
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_structured_test)
+{
+  TmpLogFile logFile;
+  {
+    SimpleLog theLog(logFile.path.c_str());
+    theLog.setOutputFormat(SimpleLog::FormatOption::OutputJSON);
+    theLog.setCommonFields({ { "facility", "test" } });
+    theLog.warning("quote \" backslash \\ tab \t end");
+    theLog.log(SimpleLog::Severity::Info, { { "run", "123" } }, "run %d", 123);
+    theLog.setOutputFormat(SimpleLog::FormatOption::OutputLogfmt);
+    theLog.log(SimpleLog::Severity::Error, { { "key", "a b" }, { "empty", "" } }, "value=%d", 1);
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+    theLog.log(SimpleLog::Severity::Info, { { "run", "123" } }, "text");
+  }
+
+  std::vector<std::string> lines = logFile.getLines();
+  BOOST_REQUIRE_EQUAL(lines.size(), 4);
+
+  // check fields, without timestamp, pid, tid and thread name
+  auto endsWith = [](const std::string& s, const std::string& end) {
+    return (s.size() >= end.size()) && (s.compare(s.size() - end.size(), end.size(), end) == 0);
+  };
+  BOOST_CHECK_EQUAL(lines[0].compare(0, 9, "{\"time\":\""), 0);
+  BOOST_CHECK(lines[0].find("\"severity\":\"warning\",\"pid\":") != std::string::npos);
+  BOOST_CHECK(endsWith(lines[0], ",\"msg\":\"quote \\\" backslash \\\\ tab \\t end\",\"facility\":\"test\"}"));
+  BOOST_CHECK(endsWith(lines[1], ",\"msg\":\"run 123\",\"facility\":\"test\",\"run\":\"123\"}"));
+  BOOST_CHECK_EQUAL(lines[2].compare(0, 5, "time="), 0);
+  BOOST_CHECK(lines[2].find(" severity=error pid=") != std::string::npos);
+  BOOST_CHECK(endsWith(lines[2], " msg=\"value=1\" facility=test key=\"a b\" empty=\"\""));
+  BOOST_CHECK_EQUAL(lines[3], "text run=123");
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_large_test)
+{
+  TmpLogFile logFile;
+  std::string large;
+  for (int i = 0; large.size() < 100000; i++) {
+    large += std::to_string(i) + " ";
+  }
+  {
+    SimpleLog theLog(logFile.path.c_str());
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowSeverityTxt | SimpleLog::FormatOption::ShowMessage);
+    theLog.error("%s", large.c_str());
+    theLog.log(SimpleLog::Severity::Info, { { "key", large.c_str() } }, "%s", "fields");
+    theLog.infoDeferred("%s", large);
+    theLog.flush();
+    theLog.setOutputFormat(SimpleLog::FormatOption::OutputLogfmt);
+    theLog.info("%s", large.c_str());
+    theLog.infoDeferred("%s", large);
+    theLog.flush();
+    theLog.info("small");
+  }
+
+  std::vector<std::string> lines = logFile.getLines();
+  BOOST_REQUIRE_EQUAL(lines.size(), 6);
+  BOOST_CHECK(lines[0] == "Error - " + large);
+  BOOST_CHECK(lines[1] == "fields key=\"" + large + "\"");
+  BOOST_CHECK(lines[2] == large);
+  for (int i = 3; i < 5; i++) {
+    BOOST_CHECK(lines[i].find(" msg=\"" + large + "\"") != std::string::npos);
+  }
+  BOOST_CHECK(lines[5].find(" msg=small") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_flightrecorder_test)
+{
+  TmpLogFile logFile;
+  TmpLogFile dumpFile;
+  {
+    SimpleLog theLog(logFile.path.c_str());
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+    BOOST_CHECK_EQUAL(theLog.enableFlightRecorder(dumpFile.path.c_str(), SimpleLog::Severity::Debug, 100, SIGUSR1), 0);
+    BOOST_CHECK(theLog.isEnabled(SimpleLog::Severity::Debug));
+    BOOST_CHECK(!theLog.isEnabled(SimpleLog::Severity::Trace));
+    for (int i = 0; i < 200; i++) {
+      theLog.debug("debug %d", i);
+    }
+    theLog.debugDeferred("deferred %d", 1);
+    theLog.info("info %d", 1);
+    theLog.flush();
+    raise(SIGUSR1);
+    theLog.disableFlightRecorder();
+    BOOST_CHECK(!theLog.isEnabled(SimpleLog::Severity::Debug));
+  }
+
+  // debug messages not in output
+  std::vector<std::string> expected = { "info 1" };
+  std::vector<std::string> lines = logFile.getLines();
+  BOOST_CHECK_EQUAL_COLLECTIONS(lines.begin(), lines.end(), expected.begin(), expected.end());
+
+  // last messages in dump
+  std::vector<std::string> dump = dumpFile.getLines();
+  BOOST_REQUIRE_EQUAL(dump.size(), 101);
+  BOOST_CHECK_EQUAL(dump[0], "SimpleLog flight recorder dump on signal " + std::to_string(SIGUSR1));
+  auto endsWith = [](const std::string& s, const std::string& end) {
+    return (s.size() >= end.size()) && (s.compare(s.size() - end.size(), end.size(), end) == 0);
+  };
+  BOOST_CHECK(endsWith(dump[1], "  d  debug 102"));
+  BOOST_CHECK(endsWith(dump[98], "  d  debug 199"));
+  // deferred messages are recorded when processed by background thread
+  BOOST_CHECK(endsWith(dump[99], "     info 1"));
+  BOOST_CHECK(endsWith(dump[100], "  d  deferred 1"));
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_socket_test)
+{
+  TmpLogFile socketFile;
+  unlink(socketFile.path.c_str());
+
+  // local socket standing in for the log service
+  auto createSocket = [&socketFile]() {
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketFile.path.c_str());
+    BOOST_REQUIRE_EQUAL(bind(fd, (struct sockaddr*)&address, sizeof(address)), 0);
+    return fd;
+  };
+  auto receive = [](int fd) {
+    char buffer[1024];
+    ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    return std::string(buffer, (n > 0) ? n : 0);
+  };
+  std::string tag = "test[" + std::to_string(getpid()) + "]: ";
+
+  int fd = createSocket();
+  SimpleLog theLog;
+  BOOST_REQUIRE_EQUAL(theLog.setSocketOutput(socketFile.path.c_str(), "test"), 0);
+  theLog.error("message %d", 1);
+  std::string msg = receive(fd);
+  BOOST_CHECK_EQUAL(msg.substr(0, 4), "<11>");
+  BOOST_CHECK_EQUAL(msg.substr(msg.size() - tag.size() - 9), tag + "message 1");
+
+  // service not available: message dropped
+  close(fd);
+  unlink(socketFile.path.c_str());
+  BOOST_CHECK_EQUAL(theLog.info("message %d", 2), -1);
+
+  fd = createSocket();
+  theLog.info("message %d", 3);
+  theLog.flush();
+  msg = receive(fd);
+  BOOST_CHECK_EQUAL(msg.substr(0, 4), "<14>");
+  BOOST_CHECK_EQUAL(msg.substr(msg.size() - 9), "message 3");
+  msg = receive(fd);
+  BOOST_CHECK_EQUAL(msg.substr(0, 4), "<12>");
+  BOOST_CHECK_EQUAL(msg.substr(msg.size() - 46), "1 messages dropped (socket output unavailable)");
+  close(fd);
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_format_test)
+{
+  TmpLogFile logFile;
+  {
+    SimpleLog theLog(logFile.path.c_str());
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowSeverityTxt | SimpleLog::FormatOption::ShowMessage);
+    std::string str = "string";
+    std::string_view view = "view";
+    const char* nullString = nullptr;
+    theLog.logFormat(SimpleLog::Severity::Info, SIMPLELOG_FORMAT("{} {} {} {} {}"), -12, 42u, 2.5, 0.1f, 'c');
+    SIMPLELOG_WARNINGF(theLog, "{}/{}/{}/{}/{}", str, view, "literal", nullString, false);
+    SIMPLELOG_ERRORF(theLog, "{{braces}} {}", (void*)0xff);
+    SIMPLELOG_INFOF(theLog, "no argument");
+
+    // arguments evaluated only when level enabled
+    nCalls = 0;
+    SIMPLELOG_DEBUGF(theLog, "debug {}", countCalls());
+    BOOST_CHECK_EQUAL(nCalls, 0);
+    theLog.setLogLevel(SimpleLog::Severity::Debug);
+    SIMPLELOG_DEBUGF(theLog, "debug {}", countCalls());
+    BOOST_CHECK_EQUAL(nCalls, 1);
+  }
+
+  std::vector<std::string> expected = { "-12 42 2.5 0.1 c", "Warning - string/view/literal/(null)/false", "Error - {braces} 0xff", "no argument", "Debug - debug 1" };
+  std::vector<std::string> lines = logFile.getLines();
+  BOOST_CHECK_EQUAL_COLLECTIONS(lines.begin(), lines.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_stats_test)
+{
+  TmpLogFile logFile;
+  SimpleLog theLog(logFile.path.c_str());
+  theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+  theLog.setDuplicatesSuppression(true);
+  theLog.info("info 1");
+  theLog.info("info 2");
+  theLog.warning("warning");
+  theLog.error("error");
+  theLog.error("error");
+  theLog.debug("not logged");
+
+  SimpleLog::Stats stats = theLog.getStats();
+  BOOST_CHECK_EQUAL(stats.messages[SimpleLog::Severity::Debug], 0);
+  BOOST_CHECK_EQUAL(stats.messages[SimpleLog::Severity::Info], 2);
+  BOOST_CHECK_EQUAL(stats.messages[SimpleLog::Severity::Warning], 1);
+  BOOST_CHECK_EQUAL(stats.messages[SimpleLog::Severity::Error], 1);
+  BOOST_CHECK_EQUAL(stats.bytes[SimpleLog::Severity::Info], 14);
+  BOOST_CHECK_EQUAL(stats.bytes[SimpleLog::Severity::Error], 6);
+  BOOST_CHECK_EQUAL(stats.suppressed, 1);
+  BOOST_CHECK_EQUAL(stats.writeFailures, 0);
+  BOOST_CHECK_EQUAL(stats.dropped, 0);
+  BOOST_CHECK_EQUAL(stats.truncations, 0);
+
+  // output not available
+  SimpleLog otherLog;
+  otherLog.setFileDescriptors(-1, -1);
+  otherLog.info("lost");
+  BOOST_CHECK_EQUAL(otherLog.getStats().writeFailures, 1);
+  BOOST_CHECK_EQUAL(otherLog.getStats().messages[SimpleLog::Severity::Info], 0);
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_rotate_period_test)
+{
+  char dirName[] = "/tmp/testSimpleLogRotate.XXXXXX";
+  BOOST_REQUIRE(mkdtemp(dirName) != NULL);
+  std::string logPath = std::string(dirName) + "/test.log";
+  {
+    SimpleLog theLog;
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+    BOOST_CHECK_EQUAL(theLog.setLogFile(logPath.c_str(), 0, 10), 0);
+    theLog.setLogRotatePeriod(1);
+    theLog.info("first period");
+    usleep(1100000);
+    theLog.info("second period");
+    usleep(1100000);
+    theLog.info("third period");
+  }
+
+  std::vector<std::string> expected = { "third period", "second period", "first period" };
+  for (unsigned int i = 0; i < expected.size(); i++) {
+    std::string path = logPath + ((i > 0) ? "." + std::to_string(i) : "");
+    std::ifstream f(path);
+    std::string line;
+    BOOST_CHECK(std::getline(f, line));
+    BOOST_CHECK_EQUAL(line, expected[i]);
+    unlink(path.c_str());
+  }
+  BOOST_CHECK_EQUAL(rmdir(dirName), 0);
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_rotate_compression_test)
+{
+  if (system("gzip --version > /dev/null 2>&1") != 0) {
+    return;
+  }
+  for (bool isSigchldIgnored : { false, true }) {
+    char dirName[] = "/tmp/testSimpleLogRotate.XXXXXX";
+    BOOST_REQUIRE(mkdtemp(dirName) != NULL);
+    std::string logPath = std::string(dirName) + "/test.log";
+    // exit status of compression command not available when SIGCHLD ignored
+    void (*previousHandler)(int) = signal(SIGCHLD, isSigchldIgnored ? SIG_IGN : SIG_DFL);
+    {
+      SimpleLog theLog;
+      theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+      theLog.setLogRotateCompression(SimpleLog::RotateCompression::RotateGzip);
+      BOOST_CHECK_EQUAL(theLog.setLogFile(logPath.c_str(), 10, 3), 0);
+      theLog.info("message 1");
+      theLog.info("message 2");
+      theLog.info("message 3");
+      // compressions are completed when the log is destroyed
+    }
+    signal(SIGCHLD, previousHandler);
+
+    std::vector<std::string> expected = { "message 3", "message 2", "message 1" };
+    for (unsigned int i = 0; i < expected.size(); i++) {
+      std::string path = logPath + ((i > 0) ? "." + std::to_string(i) : "");
+      std::string command = (i > 0) ? "gzip -dc " + path + ".gz" : "cat " + path;
+      FILE* fp = popen(command.c_str(), "r");
+      BOOST_REQUIRE(fp != NULL);
+      char line[64] = "";
+      BOOST_CHECK(fgets(line, sizeof(line), fp) != NULL);
+      pclose(fp);
+      BOOST_CHECK_EQUAL(std::string(line), expected[i] + "\n");
+      unlink(path.c_str());
+      unlink((path + ".gz").c_str());
+    }
+    BOOST_CHECK_EQUAL(rmdir(dirName), 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_rotate_recovery_test)
+{
+  char dirName[] = "/tmp/testSimpleLogRotate.XXXXXX";
+  BOOST_REQUIRE(mkdtemp(dirName) != NULL);
+  std::string logPath = std::string(dirName) + "/test.log";
+
+  // files left by an interrupted rotation, with increasing modification times
+  auto createFile = [](const std::string& path, const char* content, time_t mtime) {
+    std::ofstream(path) << content;
+    struct timespec times[2] = { { mtime, 0 }, { mtime, 0 } };
+    BOOST_CHECK_EQUAL(utimensat(AT_FDCWD, path.c_str(), times, 0), 0);
+  };
+  time_t now = time(NULL);
+
+  // process which created them is not running anymore (crash between the renames of a rotation, log file missing)
+  pid_t pid = fork();
+  BOOST_REQUIRE(pid >= 0);
+  if (pid == 0) {
+    _exit(0);
+  }
+  BOOST_REQUIRE(waitpid(pid, NULL, 0) == pid);
+  std::string deadPrefix = "." + std::to_string(pid) + ".1.";
+  createFile(logPath + ".1", "older\n", now - 40);
+  createFile(logPath + ".pending" + deadPrefix + "2", "old\n", now - 30);
+  createFile(logPath + ".next" + deadPrefix + "3", "next\n", now - 10);
+  createFile(logPath + ".next" + deadPrefix + "4", "", now);
+  createFile(logPath + ".compress" + deadPrefix + "1234.gz", "partial", now);
+  // files of a live writer are left untouched
+  std::string livePath = logPath + ".next." + std::to_string(getpid()) + ".999.1";
+  createFile(livePath, "live\n", now - 5);
+  {
+    SimpleLog theLog;
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+    BOOST_CHECK_EQUAL(theLog.setLogFile(logPath.c_str(), 0, 10), 0);
+    theLog.info("new");
+  }
+
+  std::vector<std::string> expected = { "next\nnew\n", "old\n", "older\n" };
+  for (unsigned int i = 0; i < expected.size(); i++) {
+    std::string path = logPath + ((i > 0) ? "." + std::to_string(i) : "");
+    std::ifstream f(path);
+    std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    BOOST_CHECK_EQUAL(content, expected[i]);
+    unlink(path.c_str());
+  }
+  BOOST_CHECK_EQUAL(unlink(livePath.c_str()), 0);
+  BOOST_CHECK_EQUAL(rmdir(dirName), 0);
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_rotate_shared_test)
+{
+  // two instances writing to the same path, with rotation
+  char dirName[] = "/tmp/testSimpleLogRotate.XXXXXX";
+  BOOST_REQUIRE(mkdtemp(dirName) != NULL);
+  std::string logPath = std::string(dirName) + "/test.log";
+  const int nMessages = 200;
+  auto writer = [&](int id) {
+    SimpleLog theLog;
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+    BOOST_CHECK_EQUAL(theLog.setLogFile(logPath.c_str(), 2000, 100), 0);
+    for (int i = 0; i < nMessages; i++) {
+      theLog.info("writer %d message %03d", id, i);
+    }
+  };
+  std::thread t1(writer, 1);
+  std::thread t2(writer, 2);
+  t1.join();
+  t2.join();
+
+  // all messages kept, in rotated files only
+  std::vector<std::string> lines;
+  DIR* dp = opendir(dirName);
+  BOOST_REQUIRE(dp != NULL);
+  bool isLogFound = false;
+  for (struct dirent* ep = readdir(dp); ep != NULL; ep = readdir(dp)) {
+    std::string name = ep->d_name;
+    if ((name == ".") || (name == "..")) {
+      continue;
+    }
+    BOOST_CHECK_MESSAGE((name == "test.log") || (name.find_first_not_of("0123456789", 9) == std::string::npos), "unexpected file " << name);
+    isLogFound |= (name == "test.log");
+    std::ifstream f(std::string(dirName) + "/" + name);
+    for (std::string line; std::getline(f, line);) {
+      lines.push_back(line);
+    }
+    unlink((std::string(dirName) + "/" + name).c_str());
+  }
+  closedir(dp);
+  BOOST_CHECK(isLogFound);
+  BOOST_CHECK_EQUAL(lines.size(), 2 * nMessages);
+  std::sort(lines.begin(), lines.end());
+  BOOST_CHECK(std::unique(lines.begin(), lines.end()) == lines.end());
+  BOOST_CHECK_EQUAL(rmdir(dirName), 0);
+}
@@ -0,0 +1,159 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include <Common/SimpleLog.h>
+
+#define BOOST_TEST_MODULE SimpleLog threads test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+
+// count lines in a set of log files, and check they are all complete
+// files bigger than maxFileSize (if non-zero) are counted in nBadFiles
+static int countLines(const std::string& path, unsigned int nFiles, int& nBadLines, int* nBadFiles = NULL, size_t maxFileSize = 0)
+{
+  int nLines = 0;
+  for (unsigned int i = 0; i < nFiles; i++) {
+    std::string fileName = path;
+    if (i > 0) {
+      fileName += "." + std::to_string(i);
+    }
+    std::ifstream f(fileName);
+    std::string line;
+    size_t fileSize = 0;
+    while (std::getline(f, line)) {
+      nLines++;
+      fileSize += line.length() + 1;
+      if (line.find("end of message") == std::string::npos) {
+        nBadLines++;
+      }
+    }
+    if ((nBadFiles != NULL) && (maxFileSize > 0) && (fileSize > maxFileSize)) {
+      (*nBadFiles)++;
+    }
+    unlink(fileName.c_str());
+  }
+  return nLines;
+}
+
+// log messages from several threads to a rotated file, and check result
+static void testThreads(unsigned int outputBufferSize, size_t mapStep = 0)
+{
+  char dirName[] = "/tmp/testSimpleLogThreads.XXXXXX";
+  BOOST_REQUIRE(mkdtemp(dirName) != NULL);
+  std::string logPath = std::string(dirName) + "/test.log";
+
+  const int nThreads = 8;
+  const int nMessages = 2000;
+  const unsigned int nFiles = 1000;
+  const size_t maxFileSize = 20000;
+
+  {
+    SimpleLog theLog;
+    BOOST_CHECK_EQUAL(theLog.setLogFile(logPath.c_str(), maxFileSize, nFiles, 1), 0);
+    theLog.setOutputBuffer(outputBufferSize);
+    BOOST_CHECK_EQUAL(theLog.setOutputMapped(mapStep), 0);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+      threads.push_back(std::thread([&theLog, i]() {
+        for (int j = 0; j < nMessages; j++) {
+          theLog.info("thread %d message %d end of message", i, j);
+        }
+      }));
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  int nBadLines = 0;
+  int nBadFiles = 0;
+  int nLines = countLines(logPath, nFiles, nBadLines, &nBadFiles, maxFileSize);
+  // no file left (e.g. next file created in advance)
+  BOOST_CHECK_EQUAL(rmdir(dirName), 0);
+
+  BOOST_CHECK_EQUAL(nLines, nThreads * nMessages);
+  BOOST_CHECK_EQUAL(nBadLines, 0);
+  BOOST_CHECK_EQUAL(nBadFiles, 0);
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_threads_test)
+{
+  testThreads(0);
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_buffered_test)
+{
+  testThreads(4096);
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_mapped_test)
+{
+  // small mapping steps, to extend mapping several times per file
+  testThreads(0, 4096);
+}
+
+BOOST_AUTO_TEST_CASE(simplelog_deferred_test)
+{
+  char dirName[] = "/tmp/testSimpleLogDeferred.XXXXXX";
+  BOOST_REQUIRE(mkdtemp(dirName) != NULL);
+  std::string logPath = std::string(dirName) + "/test.log";
+
+  const int nThreads = 4;
+  const int nMessages = 10000;
+  const char* format = "int %d uint %u hex %x long %ld str %s %s double %.2f char %c width [%5d] [%-5s] [%.3s] [%*d] %% end of message";
+  std::string str = "xyz";
+  char expected[1024];
+  snprintf(expected, sizeof(expected), format, -1, 42u, -1, -123456789012L, "abc", str.c_str(), 3.14159, 'Z', 7, "ab", "abcdef", 4, 8);
+
+  {
+    SimpleLog theLog;
+    theLog.setOutputFormat(SimpleLog::FormatOption::ShowMessage);
+    BOOST_CHECK_EQUAL(theLog.setLogFile(logPath.c_str()), 0);
+    BOOST_CHECK_EQUAL(theLog.infoDeferred(format, -1, 42u, -1, -123456789012L, "abc", str, 3.14159, 'Z', 7, "ab", "abcdef", 4, 8), 0);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+      threads.push_back(std::thread([&theLog, i]() {
+        for (int j = 0; j < nMessages; j++) {
+          while (theLog.infoDeferred("thread %d message %d end of message", i, j) != 0) {
+            // buffer full
+            usleep(1000);
+          }
+        }
+      }));
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  std::ifstream f(logPath);
+  std::string firstLine;
+  std::getline(f, firstLine);
+  BOOST_CHECK_EQUAL(firstLine, expected);
+  f.close();
+
+  int nBadLines = 0;
+  int nLines = countLines(logPath, 1, nBadLines);
+  rmdir(dirName);
+
+  BOOST_CHECK_EQUAL(nLines, nThreads * nMessages + 1);
+  BOOST_CHECK_EQUAL(nBadLines, 0);
+}
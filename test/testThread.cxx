@@ -0,0 +1,252 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include <Common/BasicThread.h>
+#include <Common/Fifo.h>
+#include <Common/Thread.h>
+#include <Common/ThreadOptions.h>
+
+#define BOOST_TEST_MODULE Thread test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace AliceO2::Common;
+
+// consumer loop: counts items received from a FIFO, and the number of loop calls
+struct Consumer {
+  Fifo<int> fifo{ 1000 };
+  std::atomic<int> nItems{ 0 };
+  std::atomic<int> nCalls{ 0 };
+};
+
+static Thread::CallbackResult consumerLoop(void* arg)
+{
+  Consumer* c = (Consumer*)arg;
+  c->nCalls++;
+  int value;
+  if (c->fifo.pop(value) == 0) {
+    c->nItems++;
+    return Thread::CallbackResult::Ok;
+  }
+  return Thread::CallbackResult::Idle;
+}
+
+// wait until a condition is true, up to a timeout
+template <typename F>
+static double waitFor(F condition, double timeout = 5.0)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  for (;;) {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (condition() || (elapsed > timeout)) {
+      return elapsed;
+    }
+    std::this_thread::yield();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(thread_wake_test)
+{
+  // long idle sleep, interrupted by wake()
+  Consumer c;
+  Thread t(consumerLoop, &c, "consumer", 10000000);
+  t.start();
+  waitFor([&]() { return c.nCalls >= 1; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  int nCalls = c.nCalls;
+  c.fifo.push(1);
+  t.wake();
+  double elapsed = waitFor([&]() { return c.nItems == 1; });
+  BOOST_CHECK_EQUAL(c.nItems, 1);
+  BOOST_CHECK_LT(elapsed, 1.0);
+  BOOST_CHECK_LE(c.nCalls - nCalls, 3);
+
+  // stop() interrupts sleep as well
+  auto t0 = std::chrono::steady_clock::now();
+  t.stop();
+  t.join();
+  BOOST_CHECK_LT(std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count(), 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(thread_backoff_test)
+{
+  // backoff: idle loop goes to sleep after spin/pause/yield steps, and is woken up by producer
+  Consumer c;
+  Thread t(consumerLoop, &c, "consumer", 100000);
+  t.setIdleBackoff(10, 10, 10, 10);
+  t.start();
+  for (int i = 0; i < 100; i++) {
+    c.fifo.push(i);
+    t.wake();
+    if (i % 10 == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+  waitFor([&]() { return c.nItems == 100; });
+  BOOST_CHECK_EQUAL(c.nItems, 100);
+
+  // when idle, number of calls bounded by the exponential sleep
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  int nCalls = c.nCalls;
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  BOOST_CHECK_LE(c.nCalls - nCalls, 4);
+  t.join();
+}
+
+// loop recording the settings of the thread it runs in
+struct ThreadSettings {
+  std::string name;
+  int nCpus = 0;
+  int firstCpu = -1;
+};
+
+static void getThreadSettings(ThreadSettings& settings)
+{
+  char name[16] = "";
+  pthread_getname_np(pthread_self(), name, sizeof(name));
+  settings.name = name;
+  cpu_set_t cpus;
+  if (pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0) {
+    settings.nCpus = CPU_COUNT(&cpus);
+    for (int i = 0; (i < CPU_SETSIZE) && (settings.firstCpu < 0); i++) {
+      if (CPU_ISSET(i, &cpus)) {
+        settings.firstCpu = i;
+      }
+    }
+  }
+}
+
+static Thread::CallbackResult settingsLoop(void* arg)
+{
+  getThreadSettings(*(ThreadSettings*)arg);
+  return Thread::CallbackResult::Done;
+}
+
+BOOST_AUTO_TEST_CASE(thread_options_test)
+{
+  std::vector<int> cpus;
+  BOOST_CHECK_EQUAL(parseCpuList("0-3,8,10-11", cpus), 0);
+  BOOST_CHECK((cpus == std::vector<int>{ 0, 1, 2, 3, 8, 10, 11 }));
+  BOOST_CHECK_EQUAL(parseCpuList("", cpus), 0);
+  BOOST_CHECK(cpus.empty());
+  BOOST_CHECK_EQUAL(parseCpuList("1,x", cpus), -1);
+  BOOST_CHECK_EQUAL(parseCpuList("3-1", cpus), -1);
+  BOOST_CHECK_EQUAL(parseSchedulingPolicy("FIFO"), SCHED_FIFO);
+  BOOST_CHECK_EQUAL(parseSchedulingPolicy("rr"), SCHED_RR);
+  BOOST_CHECK_EQUAL(parseSchedulingPolicy("realtime"), -1);
+
+  // run on the last CPU available to this process
+  cpu_set_t available;
+  BOOST_REQUIRE(sched_getaffinity(0, sizeof(available), &available) == 0);
+  int lastCpu = 0;
+  for (int i = 0; i < CPU_SETSIZE; i++) {
+    if (CPU_ISSET(i, &available)) {
+      lastCpu = i;
+    }
+  }
+  ThreadOptions options;
+  options.cpuSet = { lastCpu };
+
+  // Thread: name from constructor by default
+  ThreadSettings settings;
+  Thread t(settingsLoop, &settings, "myLoopThreadWithLongName");
+  t.setThreadOptions(options);
+  BOOST_CHECK_EQUAL(t.start(), 0);
+  t.join();
+  BOOST_CHECK_EQUAL(settings.name, "myLoopThreadWit");
+  BOOST_CHECK_EQUAL(settings.nCpus, 1);
+  BOOST_CHECK_EQUAL(settings.firstCpu, lastCpu);
+
+  // BasicThread
+  ThreadSettings basicSettings;
+  BasicThread bt;
+  options.name = "basic";
+  BOOST_CHECK_EQUAL(bt.start([&](std::atomic<bool>*) { getThreadSettings(basicSettings); }, options), 0);
+  bt.join();
+  BOOST_CHECK_EQUAL(basicSettings.name, "basic");
+  BOOST_CHECK_EQUAL(basicSettings.firstCpu, lastCpu);
+
+  // invalid settings are reported, thread runs anyway
+  ThreadSettings invalidSettings;
+  options.cpuSet = { CPU_SETSIZE };
+  std::string errorMessage;
+  BOOST_CHECK_EQUAL(bt.start([&](std::atomic<bool>*) { getThreadSettings(invalidSettings); }, options, &errorMessage), -1);
+  bt.join();
+  BOOST_CHECK_EQUAL(invalidSettings.name, "basic");
+  BOOST_CHECK(errorMessage.find("CPU affinity") != std::string::npos);
+  Thread invalidThread(settingsLoop, &invalidSettings, "invalid");
+  invalidThread.setThreadOptions(options);
+  errorMessage.clear();
+  BOOST_CHECK_EQUAL(invalidThread.start(&errorMessage), -1);
+  invalidThread.join();
+  BOOST_CHECK(errorMessage.find("CPU affinity") != std::string::npos);
+  errorMessage.clear();
+  options.name.clear();
+  BOOST_CHECK_EQUAL(applyThreadOptions(options, errorMessage), -1);
+  BOOST_CHECK(errorMessage.find("CPU affinity") != std::string::npos);
+}
+
+// loop busy on even calls, idle on odd calls, done after 200 calls
+static Thread::CallbackResult statsLoop(void* arg)
+{
+  std::atomic<int>& n = *(std::atomic<int>*)arg;
+  n++;
+  if (n >= 200) {
+    return Thread::CallbackResult::Done;
+  }
+  if (n % 2) {
+    return Thread::CallbackResult::Idle;
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - t0 < std::chrono::microseconds(100)) {
+  }
+  return Thread::CallbackResult::Ok;
+}
+
+BOOST_AUTO_TEST_CASE(thread_stats_test)
+{
+  std::atomic<int> n(0);
+  Thread t(statsLoop, &n, "stats", 100);
+  Thread::Stats stats = t.getStats();
+  BOOST_CHECK_EQUAL(stats.iterations[Thread::CallbackResult::Ok], 0);
+  BOOST_CHECK_EQUAL(stats.getDutyCycle(), 0);
+  BOOST_CHECK_EQUAL(stats.getDurationPercentile(0.5), 0);
+  t.start();
+  waitFor([&]() { return n >= 200; });
+  t.join();
+
+  stats = t.getStats();
+  BOOST_CHECK_EQUAL(stats.iterations[Thread::CallbackResult::Ok], 99);
+  BOOST_CHECK_EQUAL(stats.iterations[Thread::CallbackResult::Idle], 100);
+  BOOST_CHECK_EQUAL(stats.iterations[Thread::CallbackResult::Done], 1);
+  BOOST_CHECK_EQUAL(stats.iterations[Thread::CallbackResult::Error], 0);
+  unsigned long long nCalls = 0;
+  for (auto count : stats.durationHistogram) {
+    nCalls += count;
+  }
+  BOOST_CHECK_EQUAL(nCalls, 200);
+  BOOST_CHECK_GE(stats.busyTime, 99 * 100000ULL);
+  BOOST_CHECK_GE(stats.idleTime, 100 * 100000ULL);
+  BOOST_CHECK_GT(stats.getDutyCycle(), 0.1);
+  BOOST_CHECK_LT(stats.getDutyCycle(), 0.9);
+  // busy calls last at least 100us, idle ones are short
+  BOOST_CHECK_GE(stats.getDurationPercentile(0.99), 100000ULL);
+  BOOST_CHECK_LT(stats.getDurationPercentile(0.3), 100000ULL);
+}
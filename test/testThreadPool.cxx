@@ -0,0 +1,224 @@
+// Copyright 2019-2020 CERN and copyright holders of ALICE O2.
+// See https://alice-o2.web.cern.ch/copyright for details of the copyright holders.
+// All rights not expressly granted are reserved.
+//
+// This software is distributed under the terms of the GNU General Public
+// License v3 (GPL Version 3), copied verbatim in the file "COPYING".
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#include <Common/ThreadPool.h>
+
+#define BOOST_TEST_MODULE ThreadPool test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <sched.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace AliceO2::Common;
+
+BOOST_AUTO_TEST_CASE(threadpool_submit_test)
+{
+  ThreadPool pool(4, "test");
+  BOOST_CHECK_EQUAL(pool.getNumberOfWorkers(), 4);
+
+  // results and exceptions through futures
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 1000; i++) {
+    results.push_back(pool.submit([](int x) { return x * x; }, i));
+  }
+  for (int i = 0; i < 1000; i++) {
+    BOOST_CHECK_EQUAL(results[i].get(), i * i);
+  }
+
+  // move-only argument
+  auto moved = pool.submit([](std::unique_ptr<int> p) { return *p; }, std::make_unique<int>(7));
+  BOOST_CHECK_EQUAL(moved.get(), 7);
+
+  auto failed = pool.submit([]() { throw std::runtime_error("failed"); });
+  BOOST_CHECK_THROW(failed.get(), std::runtime_error);
+
+  // tasks submitted from tasks, on the worker queue, stolen by others
+  std::atomic<int> count(0);
+  std::function<void(int)> spawn = [&](int depth) {
+    count++;
+    if (depth > 0) {
+      pool.submit(spawn, depth - 1);
+      pool.submit(spawn, depth - 1);
+    }
+  };
+  pool.submit(spawn, 10);
+  pool.waitIdle();
+  BOOST_CHECK_EQUAL(count, (1 << 11) - 1);
+
+  // batch
+  std::atomic<int> sum(0);
+  std::vector<std::function<void()>> tasks;
+  for (int i = 1; i <= 100; i++) {
+    tasks.push_back([&sum, i]() { sum += i; });
+  }
+  pool.submitBatch(std::move(tasks)).get();
+  BOOST_CHECK_EQUAL(sum, 5050);
+
+  // each task executed is a busy iteration of a worker (accounted just after the task is done)
+  const unsigned long long nTasksExpected = 1000 + 1 + 1 + (1 << 11) - 1 + 100;
+  unsigned long long nTasks = 0;
+  Thread::Stats stats;
+  for (int retry = 0; (retry < 100) && (nTasks != nTasksExpected); retry++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    nTasks = 0;
+    for (int i = 0; i < pool.getNumberOfWorkers(); i++) {
+      BOOST_CHECK_EQUAL(pool.getWorkerStats(i, stats), 0);
+      nTasks += stats.iterations[Thread::CallbackResult::Ok];
+    }
+  }
+  BOOST_CHECK_EQUAL(pool.getWorkerStats(4, stats), -1);
+  BOOST_CHECK_EQUAL(nTasks, nTasksExpected);
+  BOOST_CHECK_THROW(pool.submitBatch({ []() {}, []() { throw std::logic_error("batch failed"); } }).get(), std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE(threadpool_parallel_for_test)
+{
+  ThreadPool pool(3);
+  std::vector<int> values(100000);
+  auto fill = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      values[i] = (int)i;
+    }
+  };
+  BOOST_CHECK_EQUAL(pool.parallelFor(0, values.size(), fill), 0);
+  std::vector<int> expected(values.size());
+  std::iota(expected.begin(), expected.end(), 0);
+  BOOST_CHECK(values == expected);
+
+  // nested: parallel-for called from tasks
+  std::atomic<long> total(0);
+  auto inner = [&](size_t begin, size_t end) { total += end - begin; };
+  auto outer = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      pool.parallelFor(0, 1000, inner, 10);
+    }
+  };
+  pool.parallelFor(0, 10, outer, 1);
+  BOOST_CHECK_EQUAL(total, 10000);
+
+  // exceptions of body rethrown
+  auto failing = [](size_t begin, size_t) {
+    if (begin == 5) {
+      throw std::runtime_error("part failed");
+    }
+  };
+  BOOST_CHECK_THROW(pool.parallelFor(0, 10, failing, 1), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(threadpool_wait_idle_test)
+{
+  // concurrent calls from tasks
+  ThreadPool pool(4);
+  std::atomic<int> count(0);
+  std::vector<std::future<void>> waiters;
+  for (int i = 0; i < 4; i++) {
+    waiters.push_back(pool.submit([&]() {
+      for (int j = 0; j < 10; j++) {
+        pool.submit([&count]() { count++; });
+      }
+      pool.waitIdle();
+    }));
+  }
+  for (auto& f : waiters) {
+    f.get();
+  }
+  pool.waitIdle();
+  BOOST_CHECK_EQUAL(count, 40);
+}
+
+BOOST_AUTO_TEST_CASE(threadpool_options_test)
+{
+  // options which can not be applied are reported, workers run anyway
+  std::vector<ThreadOptions> options(2);
+  options[1].cpuSet = { CPU_SETSIZE };
+  std::string errorMessage;
+  ThreadPool pool(2, "options", options, &errorMessage);
+  BOOST_CHECK(errorMessage.find("worker 1: ") == 0);
+  BOOST_CHECK(errorMessage.find("CPU affinity") != std::string::npos);
+  BOOST_CHECK_EQUAL(pool.submit([]() { return 1; }).get(), 1);
+
+  ThreadPool defaultPool(2, "options", {}, &errorMessage);
+  BOOST_CHECK_EQUAL(errorMessage, "");
+}
+
+BOOST_AUTO_TEST_CASE(threadpool_stop_test)
+{
+  // pending tasks drained when stop flag set
+  std::atomic<bool> stopFlag(false);
+  std::atomic<int> count(0);
+  ThreadPool pool(2);
+  pool.setStopFlag(&stopFlag);
+  for (int i = 0; i < 100; i++) {
+    pool.submit([&count]() {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      count++;
+    });
+  }
+  stopFlag = true;
+  BOOST_CHECK(pool.isStopped());
+  auto rejected = pool.submit([]() { return 1; });
+  BOOST_CHECK_THROW(rejected.get(), std::runtime_error);
+  BOOST_CHECK_EQUAL(pool.parallelFor(0, 10, [](size_t, size_t) {}), -1);
+  pool.stop();
+  BOOST_CHECK_EQUAL(count, 100);
+
+  // pending tasks discarded
+  ThreadPool pool2(1);
+  std::atomic<bool> release(false);
+  pool2.submit([&release]() {
+    while (!release) {
+      std::this_thread::yield();
+    }
+  });
+  std::vector<std::future<void>> discarded;
+  for (int i = 0; i < 10; i++) {
+    discarded.push_back(pool2.submit([]() {}));
+  }
+  std::thread releaser([&release]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    release = true;
+  });
+  pool2.stop(false);
+  releaser.join();
+  int nBroken = 0;
+  for (auto& f : discarded) {
+    try {
+      f.get();
+    } catch (const std::future_error&) {
+      nBroken++;
+    }
+  }
+  BOOST_CHECK_GE(nBroken, 9);
+
+  // parallel-for interrupted by stop without draining
+  ThreadPool pool3(1);
+  std::atomic<bool> started(false);
+  std::thread stopper([&]() {
+    while (!started) {
+      std::this_thread::yield();
+    }
+    pool3.stop(false);
+  });
+  auto slow = [&started](size_t, size_t) {
+    started = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  };
+  BOOST_CHECK_EQUAL(pool3.parallelFor(0, 1000, slow, 1), -1);
+  stopper.join();
+}